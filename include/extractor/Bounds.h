@@ -0,0 +1,25 @@
+#ifndef EXTRACTOR_BOUNDS_H
+#define EXTRACTOR_BOUNDS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+namespace extractor
+{
+/// A function to check that an array read from a mapped file lies within a limit, e.g. the file's size
+/// @brief - sums and products of offsets and sizes read from disk aren't computed, so they can't overflow
+/// @param offset offset of the array
+/// @param count number of elements
+/// @param elementSize size of an element
+/// @param limit offset the array must end before
+/// @return whether the array is within the limit and aligned for its elements
+inline bool
+fits(uint64_t offset, uint64_t count, size_t elementSize, uint64_t limit)
+{
+    size_t alignment = std::min<size_t>(elementSize, alignof(uint64_t));
+    return offset <= limit && count <= (limit - offset) / elementSize && offset % alignment == 0;
+}
+} // namespace extractor
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef EXTRACTOR_BUFFEREDSINK_H
+#define EXTRACTOR_BUFFEREDSINK_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace extractor
+{
+/// Output file that collects lines in memory and writes them out in large chunks
+/// @brief - the file is opened once and kept open until the sink is destroyed
+/// @brief - data reaches the disk only when the buffer exceeds its capacity or the sink is flushed
+class BufferedSink
+{
+    /// File descriptor of the output file
+    int fd = -1;
+    /// Pending data
+    std::string buffer;
+    /// Size of the buffer that triggers a write
+    size_t capacity;
+
+  public:
+    /// Default size of one chunk written to disk
+    static constexpr size_t defaultCapacity = 1 << 20;
+
+    /// Constructor to create (or truncate) a file
+    /// @param file path to the output file
+    /// @param cap number of bytes to collect before writing them to disk
+    explicit BufferedSink(const std::filesystem::path &file, size_t cap = defaultCapacity);
+
+    BufferedSink(const BufferedSink &) = delete;
+
+    BufferedSink &operator=(const BufferedSink &) = delete;
+
+    /// A function to append data to the sink
+    /// @param data bytes to append
+    void write(std::string_view data);
+
+    /// A function to write all pending data to disk
+    void flush();
+
+    /// A function to replace already written bytes, e.g. to finalize a header
+    /// @param pos offset from the beginning of the file
+    /// @param data new bytes
+    void overwrite(uint64_t pos, std::string_view data);
+
+    ~BufferedSink();
+};
+} // namespace extractor
+
+#endif
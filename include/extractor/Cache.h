@@ -0,0 +1,64 @@
+#ifndef EXTRACTOR_CACHE_H
+#define EXTRACTOR_CACHE_H
+
+#include <support/TreeSitter/TreeSitter.h>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace extractor
+{
+
+/// Tokenized content of one file, e.g. everything the extractor needs to produce any kind of output
+struct CacheEntry {
+    /// Tokenized path-contexts
+    std::vector<std::vector<treesitter::TokenizedToken>> tokens;
+    /// Terminals met in the file (hash -> name)
+    std::unordered_map<size_t, std::string> vocab;
+};
+
+/// Content-addressed on-disk cache of tokenized files
+/// @brief - an entry is keyed by the hash of a file's content and stored under a directory named after the
+/// hash of the extraction options (language, policies, limits of paths and hashing), so changing any of them never
+/// reuses stale entries
+/// @brief - entries are written to a temporary file and renamed, so concurrent runs sharing a cache are safe
+/// @brief - the layout is <dir>/<options hash>/<first 2 digits of content hash>/<content hash>
+class Cache
+{
+    /// Directory for the current options
+    std::filesystem::path dir;
+
+    /// @param key hash of a file's content
+    /// @return path to the entry
+    std::filesystem::path entryPath(uint64_t key) const;
+
+  public:
+    /// Constructor to open (or create) a cache
+    /// @param root cache directory
+    /// @param options a string with all options that affect tokenization
+    Cache(const std::filesystem::path &root, std::string_view options);
+
+    /// @param content content of a file
+    /// @param language language the file is parsed as
+    /// @return key of the file's entry
+    static uint64_t key(std::string_view content, std::string_view language = {});
+
+    /// A function to look an entry up, it's counted as a hit or a miss by the profiler
+    /// @param key key of the entry
+    /// @param size size of the file's content, used to detect hash collisions
+    /// @return the entry if it exists
+    std::optional<CacheEntry> load(uint64_t key, size_t size);
+
+    /// A function to store an entry
+    /// @param key key of the entry
+    /// @param size size of the file's content
+    /// @param entry data to store
+    void store(uint64_t key, size_t size, const CacheEntry &entry);
+};
+} // namespace extractor
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef EXTRACTOR_COMPRESSEDFILE_H
+#define EXTRACTOR_COMPRESSEDFILE_H
+
+#include <support/ThreadPool/ThreadPool.h>
+#include <extractor/BufferedSink.h>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*#########################################################################################################//
+Block-compressed file
+
+The content is cut into blocks of at most blockSize bytes, every block is an independent zlib stream, so blocks can
+be decompressed in any order and in parallel. A block splits a piece of data passed to a single write() only if the
+piece is larger than a block, e.g. for the text output blocks hold whole lines unless a line is longer than a block.
+
+All integers are stored in the host byte order:
+  |- BlockFileHeader
+  |- blocks     compressed blocks, one after another
+  |- index      BlockIndexEntry[numBlocks]
+//#########################################################################################################*/
+
+namespace extractor
+{
+
+/// Header of a block-compressed file
+struct BlockFileHeader {
+    /// file signature, always "EDBLKZIP"
+    char magic[8];
+    /// version of the format
+    uint32_t version;
+    /// size of uncompressed blocks the file was written with
+    uint32_t blockSize;
+    /// number of blocks
+    uint64_t numBlocks;
+    /// size of the whole uncompressed content
+    uint64_t rawSize;
+    /// offset of the index
+    uint64_t indexOffset;
+};
+
+/// Location of one block
+struct BlockIndexEntry {
+    /// offset of the compressed block
+    uint64_t offset;
+    /// size of the compressed block
+    uint64_t size;
+    /// offset of the block in the uncompressed content
+    uint64_t rawOffset;
+    /// size of the uncompressed block
+    uint64_t rawSize;
+};
+
+static_assert(sizeof(BlockFileHeader) == 40);
+static_assert(sizeof(BlockIndexEntry) == 32);
+
+/// Signature of a block-compressed file
+inline constexpr char blockFileMagic[8] = {'E', 'D', 'B', 'L', 'K', 'Z', 'I', 'P'};
+/// Current version of the format
+inline constexpr uint32_t blockFileVersion = 2;
+
+/// Class that writes a block-compressed file
+/// @brief - full blocks are compressed by a pool of workers while new data is collected, the pool may be shared by
+/// many files
+/// @brief - compressed blocks are written in order, at most 2 blocks of the file per worker are in flight, so memory
+/// doesn't depend on the size of the output
+class CompressedFileWriter
+{
+    /// A compressed block, it's the result of a worker's task
+    struct Block {
+        std::string compressed;
+        /// Size of the uncompressed data
+        size_t rawSize;
+    };
+
+    /// Output file
+    BufferedSink out;
+    /// Workers compressing blocks
+    threadpool::ThreadPool &pool;
+    /// Blocks in flight in order of the content
+    std::deque<std::future<Block>> pending;
+    /// Maximum number of blocks in flight
+    size_t maxPending;
+
+    /// Maximum size of uncompressed blocks
+    size_t blockSize;
+    /// zlib's compression level
+    int level;
+    /// Data of the current block
+    std::string buffer;
+
+    /// Index of blocks
+    std::vector<BlockIndexEntry> index;
+    /// Number of bytes written so far
+    uint64_t offset = 0;
+    /// Number of uncompressed bytes written so far
+    uint64_t rawOffset = 0;
+    /// Is the file complete
+    bool closed = false;
+
+    /// A function to pass the current block to the workers
+    void seal();
+
+    /// A function to wait for the oldest block in flight and write it
+    void drain();
+
+  public:
+    /// Default size of an uncompressed block
+    static constexpr size_t defaultBlockSize = 4 << 20;
+
+    /// Constructor to create (or truncate) a file
+    /// @param file path to the output file
+    /// @param workers pool compressing blocks, it should outlive the writer
+    /// @param size maximum size of uncompressed blocks, from 1 byte to 4 GiB
+    /// @param compression zlib's compression level, from 1 (fastest) to 9 (smallest)
+    CompressedFileWriter(const std::filesystem::path &file, threadpool::ThreadPool &workers,
+                         size_t size = defaultBlockSize, int compression = 6);
+
+    CompressedFileWriter(const CompressedFileWriter &) = delete;
+
+    CompressedFileWriter &operator=(const CompressedFileWriter &) = delete;
+
+    /// A function to append data, it's split between blocks only if it's larger than a block
+    /// @param data bytes to append
+    void write(std::string_view data);
+
+    /// A function to compress the rest of the data and to write the index and the header
+    void close();
+
+    ~CompressedFileWriter();
+};
+
+/// Class that gives random access to blocks of a block-compressed file through mmap
+/// @brief - block() doesn't change the reader, so blocks may be decompressed by several threads at once
+class CompressedFileReader
+{
+    /// Mapped file
+    const std::byte *data = nullptr;
+    /// Size of the mapped file
+    size_t size = 0;
+    /// Header of the file
+    const BlockFileHeader *header = nullptr;
+    /// Index of blocks
+    const BlockIndexEntry *index = nullptr;
+
+  public:
+    /// Constructor to map and validate a file
+    /// @brief - the index and every block are checked to lie within the file, blocks' raw sizes are checked against the
+    /// block size, so a corrupted file never makes block() read or allocate more than a block
+    /// @param file path to a block-compressed file
+    explicit CompressedFileReader(const std::filesystem::path &file);
+
+    CompressedFileReader(const CompressedFileReader &) = delete;
+
+    CompressedFileReader &operator=(const CompressedFileReader &) = delete;
+
+    /// @return number of blocks
+    size_t blockCount() const;
+
+    /// @return size of the whole uncompressed content
+    uint64_t rawSize() const;
+
+    /// @param i index of a block
+    /// @return location of the i'th block
+    const BlockIndexEntry &entry(size_t i) const;
+
+    /// @param i index of a block
+    /// @return uncompressed content of the i'th block
+    std::string block(size_t i) const;
+
+    ~CompressedFileReader();
+};
+} // namespace extractor
+
+#endif
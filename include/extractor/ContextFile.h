@@ -0,0 +1,179 @@
+#ifndef EXTRACTOR_CONTEXTFILE_H
+#define EXTRACTOR_CONTEXTFILE_H
+
+#include <support/TreeSitter/TreeSitter.h>
+#include <support/TreeSitter/PathInterner.h>
+#include <extractor/BufferedSink.h>
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*#########################################################################################################//
+Binary path-context file
+
+All integers are stored in the host byte order, every section starts at an 8-byte boundary:
+  |- ContextFileHeader
+  |- records    ContextRecord[total number of contexts], files' records follow each other
+  |- path table uint64_t offsets[numPaths + 1] followed by the paths' bytes, path i is [offsets[i], offsets[i + 1])
+  |- names      files' names, one after another
+  |- index      FileIndexEntry[numFiles]
+//#########################################################################################################*/
+
+namespace extractor
+{
+
+/// Header of a binary path-context file
+struct ContextFileHeader {
+    /// file signature, always "EDCTXBIN"
+    char magic[8];
+    /// version of the format
+    uint32_t version;
+    /// reserved for future use
+    uint32_t flags;
+    /// number of files (records' groups)
+    uint64_t numFiles;
+    /// number of distinct paths
+    uint64_t numPaths;
+    /// offset of the path table
+    uint64_t pathsOffset;
+    /// offset of the names' section
+    uint64_t namesOffset;
+    /// offset of the index
+    uint64_t indexOffset;
+};
+
+/// One path-context of a file
+struct ContextRecord {
+    /// index of the path in the path table
+    uint32_t path;
+    /// padding, always 0
+    uint32_t reserved;
+    /// hash of the first terminal of a leaf-to-leaf path, 0 if the path starts at the root
+    uint64_t from;
+    /// hash of the (last) terminal
+    uint64_t terminal;
+};
+
+/// Location of one file's data
+struct FileIndexEntry {
+    /// offset of the file's first record
+    uint64_t offset;
+    /// number of records
+    uint64_t count;
+    /// offset of the file's name
+    uint64_t nameOffset;
+    /// length of the file's name
+    uint64_t nameSize;
+};
+
+static_assert(sizeof(ContextFileHeader) == 56);
+static_assert(sizeof(ContextRecord) == 24);
+static_assert(sizeof(FileIndexEntry) == 32);
+
+/// Signature of a binary path-context file
+inline constexpr char contextFileMagic[8] = {'E', 'D', 'C', 'T', 'X', 'B', 'I', 'N'};
+/// Current version of the format
+inline constexpr uint32_t contextFileVersion = 2;
+
+/// Class that writes a binary path-context file
+/// @brief - records are streamed to disk as soon as a file is added
+/// @brief - names and the index are kept in memory and written by close(), the path table is taken from the
+/// interner the records' ids come from
+class ContextFileWriter
+{
+    /// Output file
+    BufferedSink out;
+    /// Source of the paths' ids
+    const treesitter::PathInterner &interner;
+    /// Concatenated files' names
+    std::string names;
+    /// Index of files
+    std::vector<FileIndexEntry> index;
+    /// Number of bytes written so far
+    uint64_t offset = 0;
+    /// Is the file complete
+    bool closed = false;
+
+    /// A function to append data keeping track of the offset
+    /// @param data bytes to write
+    void append(std::string_view data);
+
+    /// A function to pad the file up to the next 8-byte boundary
+    void align();
+
+  public:
+    /// Constructor to create (or truncate) a file
+    /// @param file path to the output file
+    /// @param paths interner the records' path ids come from
+    ContextFileWriter(const std::filesystem::path &file, const treesitter::PathInterner &paths);
+
+    ContextFileWriter(const ContextFileWriter &) = delete;
+
+    ContextFileWriter &operator=(const ContextFileWriter &) = delete;
+
+    /// A function to add a file's path-contexts
+    /// @param name name of the file
+    /// @param contexts file's path-contexts
+    void write(std::string_view name, const std::vector<treesitter::PathContext> &contexts);
+
+    /// A function to write the path table, names and the index and to finalize the header
+    void close();
+
+    ~ContextFileWriter();
+};
+
+/// Class that gives random access to a binary path-context file through mmap
+/// @brief - nothing is parsed or copied, all returned views point into the mapped file
+class ContextFileReader
+{
+    /// Mapped file
+    const std::byte *data = nullptr;
+    /// Size of the mapped file
+    size_t size = 0;
+    /// Header of the file
+    const ContextFileHeader *header = nullptr;
+    /// Offsets of the paths
+    const uint64_t *pathOffsets = nullptr;
+    /// Paths' bytes
+    const char *pathBytes = nullptr;
+    /// Index of files
+    const FileIndexEntry *index = nullptr;
+
+  public:
+    /// Constructor to map and validate a file
+    /// @brief - the header, the path table and every index entry are checked to lie within the file, so views of
+    /// files and paths never point outside of it, records' path ids are not checked
+    /// @param file path to a binary path-context file
+    explicit ContextFileReader(const std::filesystem::path &file);
+
+    ContextFileReader(const ContextFileReader &) = delete;
+
+    ContextFileReader &operator=(const ContextFileReader &) = delete;
+
+    /// @return number of files
+    size_t fileCount() const;
+
+    /// @return number of distinct paths
+    size_t pathCount() const;
+
+    /// @param i index of a file
+    /// @return name of the i'th file
+    std::string_view fileName(size_t i) const;
+
+    /// @param i index of a file
+    /// @return path-contexts of the i'th file
+    std::span<const ContextRecord> contexts(size_t i) const;
+
+    /// @param id index of a path, less than pathCount()
+    /// @return path in format idid...id, "^" precedes the LCA of a leaf-to-leaf path
+    std::string_view path(uint32_t id) const;
+
+    ~ContextFileReader();
+};
+} // namespace extractor
+
+#endif
@@ -2,7 +2,14 @@
 #define EXTRACTOR_EXTRACTOR_H
 
 #include <support/TreeSitter/TreeSitter.h>
+#include <support/TreeSitter/PathInterner.h>
+#include <support/TreeSitter/ScratchArena.h>
 #include <support/ThreadPool/ThreadPool.h>
+#include <support/Profiler/Profiler.h>
+#include <extractor/BufferedSink.h>
+#include <extractor/Writer.h>
+#include <extractor/Vocabulary.h>
+#include <extractor/Cache.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -14,48 +21,485 @@
 #include <chrono>
 #include <mutex>
 #include <unordered_map>
-#include <format>
+#include <memory>
+#include <semaphore>
+#include <thread>
+#include <string_view>
+#include <span>
+#include <atomic>
+#include <optional>
+#include <exception>
 
 namespace extractor
 {
 /// lock
-std::mutex mut;
+inline std::mutex mut;
+
+/// Output of the paths of one subtree, see treesitter::SubtreeMemo
+struct MemoEntry {
+    /// " <path> <path>..." for the text output
+    std::string line;
+    /// Contexts for the interned outputs
+    std::vector<treesitter::PathContext> contexts;
+    /// Number of path-contexts
+    size_t numPaths;
+    /// Vocabulary entries of the paths' terminals
+    std::vector<std::pair<size_t, std::string>> vocab;
+};
+
+/// Outputs of the files of one language
+/// @brief - grammar symbols of different languages don't match, so every language has its own paths and files
+struct Channel {
+    /// The language
+    const treesitter::Language &language;
+    /// Encodings of the language's grammar symbols
+    const treesitter::SymbolEncoding &symbols;
+    /// Prefix of the output files
+    std::string prefix;
+    /// Table of the language's paths
+    treesitter::PathInterner paths;
+    /// Output stage
+    std::unique_ptr<Writer> writer;
+    /// Outputs of subtrees seen in the language's files, path ids in them are ids in paths
+    treesitter::SubtreeMemo<MemoEntry> memo;
+
+    /// @param lang the language
+    /// @param pref prefix of the output files
+    /// @param memoBytes maximum size of the memo, 0 disables it
+    Channel(const treesitter::Language &lang, std::string pref, size_t memoBytes = 0)
+        : language(lang), symbols(treesitter::SymbolEncoding::of(lang.grammar())), prefix(std::move(pref)),
+          memo(memoBytes)
+    {
+    }
+};
+
+/// State shared by all workers of one run
+struct Session {
+    /// Outputs indexed by Language::id, only languages of the run have them
+    std::vector<std::unique_ptr<Channel>> &channels;
+    /// Global vocabulary
+    Vocabulary &vocabulary;
+    /// Cache of tokenized files, nullptr if disabled
+    Cache *cache;
+    /// Language of all files, nullptr if it's detected by a file's extension
+    const treesitter::Language *language;
+    /// Is error set
+    std::atomic_flag failed;
+    /// The first exception of the run's tasks, it's rethrown once the pool is done
+    std::exception_ptr error;
+
+    /// A function to run the body of a task and keep its exception if it's the first one
+    /// @brief - tasks' futures are dropped, so memory doesn't depend on the number of tasks
+    /// @param f the body
+    template <typename F>
+    void
+    guard(F &&f)
+    {
+        try {
+            std::forward<F>(f)();
+        } catch (...) {
+            if (!failed.test_and_set(std::memory_order_relaxed)) {
+                error = std::current_exception();
+            }
+        }
+    }
+};
+
+/// A function to write an interned path table in format "<size>\n<id> <idid...id>\n..."
+/// @param paths interner to dump
+/// @param file path to the resulting file
+void writePaths(const treesitter::PathInterner &paths, const std::filesystem::path &file);
+
+/// A function to get the limits of paths from extraction options
+template <typename Parameters>
+treesitter::TraversalLimits
+limits(const Parameters &params)
+{
+    return {params.maxLen, params.maxWidth};
+}
+
+/// Path-contexts of a file, or of one part of a file, rendered for the output
+/// @brief - it's a treesitter::FragmentConsumer, outputs of subtrees are kept in the channel's memo
+template <typename Pipeline> struct Collector {
+    /// Shared state of the run
+    Session &session;
+    /// Outputs of the file's language
+    Channel &channel;
+    /// Whether the output renders interned paths itself
+    bool interned;
+    /// " <path> <path>..." for the text output
+    std::string line;
+    /// Contexts for the interned outputs
+    std::vector<treesitter::PathContext> contexts;
+    /// Vocabulary of the path-contexts
+    treesitter::FileVocabulary vocab;
+    /// Number of path-contexts
+    size_t numPaths = 0;
+    /// Time of splitting the path-contexts in nanoseconds, it's recorded once per file by finish()
+    uint64_t splitNs = 0;
+
+    /// Subtree being recorded, its output starts at these positions
+    struct Recording {
+        uint64_t hash;
+        size_t line;
+        size_t contexts;
+        size_t numPaths;
+        size_t splicedVocab;
+    };
+    /// Subtrees being recorded, the innermost one is the last
+    std::vector<Recording> recordings;
+    /// Vocabulary entries of the subtrees spliced into the recorded ones
+    std::vector<std::pair<size_t, std::string_view>> splicedVocab;
+
+    /// @param s shared state of the run
+    /// @param c outputs of the file's language
+    /// @param intern whether the output renders interned paths itself
+    /// @param resource memory of the vocabulary
+    Collector(Session &s, Channel &c, bool intern,
+              std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : session(s), channel(c), interned(intern), vocab(resource)
+    {
+    }
+
+    void
+    operator()(std::span<const treesitter::TokenizedToken> tokens)
+    {
+        ++numPaths;
+        if (interned) {
+            // the turn marker is a symbol of the path, so it's part of the interned path as well
+            size_t from = Pipeline::Traversal::twoTerminals ? tokens.front().name : 0;
+            contexts.push_back({channel.paths.intern(tokens), from, tokens.back().name});
+        } else {
+            // a path is split within the traversal, so its time is summed instead of being a sample of its own
+            bool timed = profiler::Profiler::instance().isEnabled();
+            auto start = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+            line.push_back(' ');
+            Pipeline::Split::split(channel.symbols, tokens, line);
+            if (timed) {
+                splitNs += std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+    }
+
+    bool
+    splice(uint64_t hash, treesitter::FileVocabulary &v)
+    {
+        if (!channel.memo.enabled()) {
+            return false;
+        }
+        profiler::count(profiler::Counter::MemoLookups);
+        auto entry = channel.memo.find(hash);
+        if (entry == nullptr) {
+            return false;
+        }
+        profiler::count(profiler::Counter::MemoHits);
+        line += entry->line;
+        contexts.insert(contexts.end(), entry->contexts.begin(), entry->contexts.end());
+        numPaths += entry->numPaths;
+        for (const auto &[name, text] : entry->vocab) {
+            v[name] = text;
+        }
+        if (!recordings.empty()) {
+            splicedVocab.insert(splicedVocab.end(), entry->vocab.begin(), entry->vocab.end());
+        }
+        return true;
+    }
+
+    bool
+    open(uint64_t hash)
+    {
+        if (!channel.memo.enabled() || channel.memo.full()) {
+            return false;
+        }
+        recordings.push_back({hash, line.size(), contexts.size(), numPaths, splicedVocab.size()});
+        return true;
+    }
+
+    void
+    close(std::span<const std::pair<size_t, std::string_view>> terminals)
+    {
+        auto recording = recordings.back();
+        recordings.pop_back();
+        MemoEntry entry{line.substr(recording.line),
+                        {contexts.begin() + recording.contexts, contexts.end()},
+                        numPaths - recording.numPaths};
+        entry.vocab.assign(terminals.begin(), terminals.end());
+        entry.vocab.insert(entry.vocab.end(), splicedVocab.begin() + recording.splicedVocab, splicedVocab.end());
+        size_t bytes = sizeof(MemoEntry) + entry.line.size() +
+                       entry.contexts.size() * sizeof(treesitter::PathContext);
+        for (const auto &[name, text] : entry.vocab) {
+            bytes += sizeof(name) + sizeof(text) + text.size();
+        }
+        channel.memo.insert(recording.hash, std::move(entry), bytes);
+        if (recordings.empty()) {
+            splicedVocab.clear();
+        }
+    }
+};
+
+/// A function to join the parts of a file in order and pass the file to the output stage
+/// @param name name of the file
+/// @param source path of the file relative to the dataset's directory
+/// @param parts collected parts of the file
+template <typename Pipeline>
+void
+finish(std::string name, std::string source, std::span<Collector<Pipeline>> parts)
+{
+    auto &session = parts.front().session;
+    FileResult result{std::move(name), std::move(source)};
+    size_t numPaths = 0;
+    uint64_t splitNs = 0;
+    if (!parts.front().interned) {
+        result.line = result.name;
+    }
+    for (auto &part : parts) {
+        result.line += part.line;
+        result.contexts.insert(result.contexts.end(), part.contexts.begin(), part.contexts.end());
+        session.vocabulary.merge(part.vocab);
+        numPaths += part.numPaths;
+        splitNs += part.splitNs;
+    }
+    if (!parts.front().interned) {
+        result.line += "\n";
+    }
+
+    if (!parts.front().interned && profiler::Profiler::instance().isEnabled()) {
+        profiler::Profiler::instance().record(profiler::Stage::Split, splitNs);
+    }
+    profiler::count(profiler::Counter::Files);
+    profiler::count(profiler::Counter::PathsEmitted, numPaths);
+
+    parts.front().channel.writer->push(std::move(result));
+}
+
+/// A file whose parts are extracted by different workers, the last finished part passes it to the output stage
+template <typename Pipeline> struct SplitFile {
+    std::string name;
+    std::string source;
+    /// Scratch memory of the tree, nullptr if it's on the heap
+    std::unique_ptr<treesitter::Arena> arena;
+    std::unique_ptr<treesitter::Tree<Pipeline>> tree;
+    std::vector<Collector<Pipeline>> parts;
+    /// Number of parts not finished yet
+    std::atomic_size_t left;
+};
+
+/// A function to extract one part of a file
+/// @param file the file
+/// @param part index of the part
+template <typename Pipeline>
+void
+extractPart(const std::shared_ptr<SplitFile<Pipeline>> &file, size_t part)
+{
+    {
+        profiler::ScopedTimer timer(profiler::Stage::Traversal);
+        auto &collector = file->parts[part];
+        file->tree->visitPart(part, collector.vocab, collector);
+    }
+    if (file->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        file->tree.reset();
+        finish<Pipeline>(std::move(file->name), std::move(file->source), file->parts);
+    }
+}
+
+// Function that streams tokenized path-contexts of a file from the cache, the file is parsed on a miss
+// >> file - source file name
+// >> lang - language of the file
+// >> params - extraction options
+// >> cache - cache of tokenized files
+// >> vocab - vocabulary of the file, the tree is allocated from its memory resource
+// >> emit - consumer of path-contexts, only the cache keeps a copy of them
+template <typename Pipeline, typename Parameters, typename Emit>
+void
+tokenize(const std::filesystem::path &file, const treesitter::Language &lang, const Parameters &params, Cache *cache,
+         treesitter::FileVocabulary &vocab, Emit &&emit)
+{
+    treesitter::SourceBuffer content;
+    {
+        profiler::ScopedTimer timer(profiler::Stage::Read);
+        content = treesitter::SourceBuffer(file);
+        profiler::count(profiler::Counter::BytesRead, content.view().size());
+    }
+    auto key = Cache::key(content.view(), lang.name);
+    auto size = content.view().size();
+    if (auto entry = cache->load(key, size)) {
+        for (const auto &tokens : entry->tokens) {
+            emit(std::span<const treesitter::TokenizedToken>(tokens));
+        }
+        for (const auto &[hash, name] : entry->vocab) {
+            vocab.emplace(hash, std::string_view(name));
+        }
+        return;
+    }
+
+    // the file isn't read twice, the tree takes the buffer over
+    treesitter::Tree<Pipeline> t(std::move(content), lang, limits(params), vocab.get_allocator().resource());
+    CacheEntry entry;
+    {
+        profiler::ScopedTimer timer(profiler::Stage::Traversal);
+        t.visit([&](std::span<const treesitter::TokenizedToken> tokens) {
+            entry.tokens.emplace_back(tokens.begin(), tokens.end());
+            emit(tokens);
+        });
+    }
+    for (const auto &[hash, name] : t.vocab) {
+        entry.vocab.emplace(hash, std::string_view(name));
+    }
+    cache->store(key, size, entry);
+    vocab = std::move(t.vocab);
+}
 
 // Function that extracts all triplets (<token><path><token>)
 // >> file - source file name
-// >> db - path to metadata.db
-template <typename Parameters>
+// >> params - extraction options
+// >> session - shared outputs, vocabulary and cache
+// >> pool - pool running extraction tasks, parts of a large tree are extracted by their own tasks
+template <typename Pipeline, typename Parameters>
 void
-extract(const std::filesystem::path &file, const Parameters &params, const std::filesystem::path &tempDir)
+extract(const std::filesystem::path &file, const Parameters &params, Session &session, threadpool::ThreadPool &pool)
 {
-    treesitter::Tree t(file, params.lang, params.traversal, params.token, params.split);
-    auto res = t.process();
-    std::string line = file.filename().stem();
-    for (const auto &v : res) {
-        line += " " + v;
+    auto lang = session.language ? session.language : treesitter::LanguageRegistry::byExtension(file);
+    if (lang == nullptr) {
+        // not a source file
+        return;
     }
-    line += "\n";
+    auto &channel = *session.channels[lang->id];
+    // files of different subdirectories may have the same name
+    auto source = file.lexically_relative(params.dir).generic_string();
+    // the output renders interned paths itself, their ids may still be renumbered
+    bool interned = params.format == "binary" || params.intern;
+    // scratch memory of the file is released at once when it's done
+    std::optional<treesitter::ScratchArena> scratch;
+    if (params.arena) {
+        scratch.emplace();
+    }
+    auto resource = scratch ? scratch->resource() : std::pmr::get_default_resource();
 
-    std::stringstream ss;
-    ss << std::this_thread::get_id();
-    auto id = ss.str();
+    if (session.cache == nullptr) {
+        auto tree = std::make_unique<treesitter::Tree<Pipeline>>(file, *lang, limits(params), resource);
+        if (size_t numParts = tree->parts(); numParts > 1) {
+            // the tree outlives this task, so does its memory
+            auto split = std::make_shared<SplitFile<Pipeline>>(
+                file.filename().stem(), source, scratch ? scratch->detach() : nullptr, std::move(tree));
+            for (size_t i = 0; i < numParts; ++i) {
+                split->parts.emplace_back(session, channel, interned);
+            }
+            split->left = numParts;
+            for (size_t i = 0; i < numParts; ++i) {
+                auto res = pool.addTask(
+                    [&session, split, i] { session.guard([&] { extractor::extractPart<Pipeline>(split, i); }); });
+            }
+            return;
+        }
+        Collector<Pipeline> collector(session, channel, interned, resource);
+        {
+            profiler::ScopedTimer timer(profiler::Stage::Traversal);
+            tree->visit(collector);
+        }
+        collector.vocab = std::move(tree->vocab);
+        tree.reset();
+        finish<Pipeline>(file.filename().stem(), std::move(source), std::span(&collector, 1));
+        return;
+    }
 
-    auto outFile = tempDir / "tokens" / (id + ".txt");
+    // path-contexts are consumed as soon as they are found
+    Collector<Pipeline> collector(session, channel, interned, resource);
+    tokenize<Pipeline>(file, *lang, params, session.cache, collector.vocab, collector);
+    finish<Pipeline>(file.filename().stem(), std::move(source), std::span(&collector, 1));
+}
 
-    std::ofstream tempFile(outFile, std::ios::app);
-    tempFile << line;
-    tempFile.close();
+// Function that walks a directory and feeds its files to the pool in batches as soon as they are found
+// >> dir - directory to walk
+// >> params - extraction options
+// >> session - shared state passed to extraction tasks
+// >> pool - pool running extraction tasks, each subdirectory is walked by its own task, a bounded pool runs a batch
+// in the walking task when it's full, so a large directory isn't held in the pool at once
+template <typename Pipeline, typename Parameters>
+void
+scan(const std::filesystem::path &dir, const Parameters &params, Session &session, threadpool::ThreadPool &pool)
+{
+    // files are extracted by chunks, so a task is allocated per chunk, not per file
+    constexpr size_t filesPerBatch = 256;
+    auto submit = [&params, &session, &pool](std::vector<std::filesystem::path> files) {
+        auto res = pool.addBatch(std::move(files), [&params, &session, &pool](const std::filesystem::path &file) {
+            session.guard([&] { extractor::extract<Pipeline, Parameters>(file, params, session, pool); });
+        });
+    };
 
-    auto outVocab = tempDir / "vocabs" / (id + ".txt");
-    std::ofstream tempVocab(outVocab, std::ios::app);
-    for (auto &[hash, tok] : t.vocab) {
-        tempVocab << "___[BOS]___ " << hash << " " << tok << "\n";
+    std::error_code ec;
+    std::vector<std::filesystem::path> files;
+    for (std::filesystem::directory_iterator it{dir, ec}, end; !ec && it != end; it.increment(ec)) {
+        const auto &entry = *it;
+        if (entry.is_symlink(ec)) {
+            // don't follow links to avoid cycles
+            continue;
+        }
+        if (entry.is_directory(ec)) {
+            auto res = pool.addTask([&params, &session, &pool, dir = entry.path()] {
+                session.guard([&] { extractor::scan<Pipeline, Parameters>(dir, params, session, pool); });
+            });
+        } else if (entry.is_regular_file(ec)) {
+            files.push_back(entry.path());
+            if (files.size() == filesPerBatch) {
+                submit(std::exchange(files, {}));
+            }
+        }
     }
-    tempVocab.close();
+    submit(std::move(files));
 }
 
 class Extractor
 {
+    /// Number of results each worker may have in the writer's queue
+    static constexpr size_t queueSizePerThread = 64;
+    /// Number of tasks each worker may have waiting in the pool, memory doesn't depend on the size of the dataset
+    static constexpr size_t tasksPerThread = 16;
+
+    /// @param params extraction options
+    /// @return kind of the queues of the pool and the writers
+    template <typename Parameters>
+    static threadpool::QueueKind
+    queueKind(const Parameters &params)
+    {
+        return params.queue == "lock_free" ? threadpool::QueueKind::LockFree : threadpool::QueueKind::Locked;
+    }
+
+    /// A function to create the output files of a channel and start its writer
+    /// @param channel the channel
+    /// @param tokensDir directory of the output files
+    /// @param params extraction options
+    /// @param header first line of text outputs, nothing if empty
+    /// @param compression pool compressing blocks of all compressed outputs
+    template <typename Parameters>
+    void
+    open(Channel &channel, const std::filesystem::path &tokensDir, const Parameters &params, const std::string &header,
+         threadpool::ThreadPool &compression)
+    {
+        const auto &prefix = channel.prefix;
+        std::vector<std::unique_ptr<ContextOutput>> outputs;
+        for (size_t i = 0; i < params.shards; ++i) {
+            // <prefix>_tokens.txt or <prefix>_tokens.<shard>.txt
+            auto suffix = params.shards == 1 ? std::string() : std::format(".{}", i);
+            std::filesystem::path file;
+            std::unique_ptr<ContextOutput> output;
+            if (params.format == "binary") {
+                file = tokensDir / (prefix + "_contexts" + suffix + ".bin");
+                output = std::make_unique<BinaryOutput>(file, channel.paths);
+            } else if (params.compress) {
+                file = tokensDir / (prefix + "_tokens" + suffix + ".txt.z");
+                output = std::make_unique<CompressedTextOutput>(file, params.intern, compression, header);
+            } else {
+                file = tokensDir / (prefix + "_tokens" + suffix + ".txt");
+                output = std::make_unique<TextOutput>(file, params.intern, header);
+            }
+            if (params.deterministic) {
+                output = std::make_unique<SortedOutput>(std::move(output), file.string() + ".spill", channel.paths);
+            }
+            outputs.push_back(std::move(output));
+        }
+        channel.writer =
+            std::make_unique<Writer>(std::move(outputs), params.numThreads * queueSizePerThread, queueKind(params));
+    }
 
   public:
     // Function that runs extractor
@@ -73,75 +517,67 @@ class Extractor
         auto dirName = dirPath.filename().stem();
         std::filesystem::path tokensDir = outDirPath / dirName;
         std::filesystem::create_directory(tokensDir);
-        std::filesystem::create_directory(tokensDir / "temp");
-        std::filesystem::create_directory(tokensDir / "temp" / "tokens");
-        std::filesystem::create_directory(tokensDir / "temp" / "vocabs");
 
-        std::vector<std::filesystem::path> filePaths;
-        for (auto const &dir_entry : std::filesystem::directory_iterator{dirPath}) {
-            filePaths.push_back(dir_entry.path());
+        if (!params.profile.empty()) {
+            profiler::Profiler::instance().enable();
         }
+        treesitter::Tokenizer::seed = params.seed;
+        auto header = params.hashHeader ? hashing::header(params.seed) : std::string();
 
-        std::filesystem::path tempDir = tokensDir / "temp";
-
-        // run threadpool
-        {
-            threadpool::ThreadPool pool(params.numThreads);
-            for (auto &file : filePaths) {
-                auto res =
-                    pool.addTask(extractor::extract<Parameters>, std::ref(file), std::ref(params), std::ref(tempDir));
+        auto prefix = params.traversal + "|" + params.token + "|" + params.split;
+        // one pool compresses the blocks of every shard of every language, it outlives the channels
+        threadpool::ThreadPool compression(params.format == "text" && params.compress ? params.numThreads : 0);
+        // languages are detected per file, each of them gets its own <lang>|<prefix>_... files
+        const treesitter::Language *language =
+            params.lang == "auto" ? nullptr : &treesitter::LanguageRegistry::byName(params.lang);
+        std::vector<std::unique_ptr<Channel>> channels(treesitter::LanguageRegistry::all().size());
+        for (const auto &lang : treesitter::LanguageRegistry::all()) {
+            if (language != nullptr && language != &lang) {
+                continue;
             }
+            auto &channel = channels[lang.id];
+            channel = std::make_unique<Channel>(lang, language ? prefix : std::format("{}|{}", lang.name, prefix),
+                                                params.memo << 20);
+            open(*channel, tokensDir, params, header, compression);
         }
+        Vocabulary vocabulary;
+        std::unique_ptr<Cache> cache;
+        if (!params.cache.empty()) {
+            cache = std::make_unique<Cache>(params.cache,
+                                            std::format("{}|{}|{}|{}|{}:{}", params.lang, prefix, params.maxLen,
+                                                        params.maxWidth, hashing::algorithm, params.seed));
+        }
+        Session session{channels, vocabulary, cache.get(), language};
 
-        // unite all files with path-contexts into one
-        std::ofstream outFile(tokensDir / (params.traversal + "|" + params.token + "|" + params.split + "_tokens.txt"));
-        for (auto const &dir_entry : std::filesystem::directory_iterator{tokensDir / "temp" / "tokens"}) {
-            std::ifstream f(dir_entry.path());
-            outFile << f.rdbuf();
-            f.close();
-        }
-        outFile.close();
-
-        // create a vocabulary
-        std::unordered_map<std::string, std::string> globalVocab;
-        for (auto const &dir_entry : std::filesystem::directory_iterator{tokensDir / "temp" / "vocabs"}) {
-            std::ifstream f(dir_entry.path());
-
-            std::string line;
-            std::string number;
-            std::string content;
-            while (std::getline(f, line, '\n')) {
-                std::stringstream lineStream(line);
-                std::string bos;
-                std::getline(lineStream, bos, ' ');
-                if (bos != "___[BOS]___") {
-                    content += "\n" + line;
-                } else {
-                    // begin of string
-                    if (!number.empty()) {
-                        globalVocab[number] = content;
-                    }
-                    std::getline(lineStream, number, ' ');
-                    std::getline(lineStream, content);
-                }
-            }
+        // run threadpool, the dataset is walked by the pool itself
+        // options are mapped to a pipeline once, everything below is specialized for it
+        treesitter::withPipeline(params.traversal, params.token, params.split, [&](auto pipeline) {
+            using Pipeline = typename decltype(pipeline)::type;
+            threadpool::ThreadPool pool(params.numThreads, tasksPerThread * params.numThreads, queueKind(params));
+            auto res = pool.addTask([&params, &session, &pool, &dirPath] {
+                session.guard([&] { extractor::scan<Pipeline, Parameters>(dirPath, params, session, pool); });
+            });
+        });
+        // the pool is done, a failure of any task is rethrown
+        if (session.error) {
+            std::rethrow_exception(session.error);
+        }
 
-            if (!number.empty()) {
-                globalVocab[number] = content;
+        for (auto &channel : channels) {
+            if (channel == nullptr) {
+                continue;
+            }
+            channel->writer->close();
+            if (params.format == "text" && params.intern) {
+                // ids are already canonical if the outputs are deterministic
+                writePaths(channel->paths, tokensDir / (channel->prefix + "_paths.txt"));
             }
-
-            f.close();
         }
-        std::ofstream outVocab(tokensDir /
-                               (params.traversal + "|" + params.token + "|" + params.split + "_mapping.txt"));
-        outVocab << globalVocab.size() << "\n";
-        for (auto &[hash, tok] : globalVocab) {
-            outVocab << "___[BOS]___ " << hash << " " << tok << "\n";
+        // terminals' hashes don't depend on the language, the vocabulary is shared
+        vocabulary.write(tokensDir / (prefix + "_mapping.txt"), header);
+        if (!params.profile.empty()) {
+            profiler::Profiler::instance().report(params.profile);
         }
-
-        outVocab.close();
-
-        std::filesystem::remove_all(tokensDir / "temp");
     }
 };
 } // namespace extractor
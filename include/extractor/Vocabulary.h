@@ -0,0 +1,63 @@
+#ifndef EXTRACTOR_VOCABULARY_H
+#define EXTRACTOR_VOCABULARY_H
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace extractor
+{
+
+/// Global vocabulary storing mapping between terminals' hashes and their names
+/// @brief - the map is split into shards, each protected by its own lock, so workers can fill it concurrently
+/// @brief - lookups of already known terminals (the vast majority) take a shared lock only
+class Vocabulary
+{
+    /// Number of shards, a power of 2
+    static constexpr size_t numShards = 64;
+
+    /// One part of the vocabulary
+    struct alignas(64) Shard {
+        std::shared_mutex m;
+        std::unordered_map<size_t, std::string> map;
+    };
+
+    std::array<Shard, numShards> shards;
+
+    /// @param hash hash of a terminal
+    /// @return the shard the terminal belongs to
+    Shard &shard(size_t hash);
+
+  public:
+    /// A function to add a terminal if it's not known yet
+    /// @param hash hash of the terminal
+    /// @param name terminal's name
+    void insert(size_t hash, std::string_view name);
+
+    /// A function to add all terminals of one file
+    /// @param vocab file's vocabulary (hash -> name)
+    template <typename Map>
+    void
+    merge(const Map &vocab)
+    {
+        for (const auto &[hash, name] : vocab) {
+            insert(hash, name);
+        }
+    }
+
+    /// @return number of distinct terminals
+    size_t size();
+
+    /// A function to write the vocabulary in format "<size>\n___[BOS]___ <hash> <name>\n..." sorted by hash
+    /// @brief - should be called once all workers are done
+    /// @param file path to the resulting mapping file
+    /// @param header first line of the file, nothing if empty
+    void write(const std::filesystem::path &file, std::string_view header = {});
+};
+} // namespace extractor
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef EXTRACTOR_WRITER_H
+#define EXTRACTOR_WRITER_H
+
+#include <support/TreeSitter/TreeSitter.h>
+#include <support/TreeSitter/PathInterner.h>
+#include <support/ThreadPool/ThreadSafeQueue.h>
+#include <support/ThreadPool/MPMCRing.h>
+#include <extractor/BufferedSink.h>
+#include <extractor/ContextFile.h>
+#include <extractor/CompressedFile.h>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <semaphore>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <vector>
+
+namespace extractor
+{
+
+/// Extraction result of one source file
+struct FileResult {
+    /// Name of the file
+    std::string name;
+    /// Path of the file relative to the dataset's directory, unlike the name it's unique
+    std::string source;
+    /// Line of the tokens file: file name followed by its path-contexts (text output)
+    std::string line;
+    /// Path-contexts with interned paths (binary and interned text output)
+    std::vector<treesitter::PathContext> contexts;
+};
+
+/// Abstract class representing the resulting file with path-contexts
+struct ContextOutput {
+
+    virtual ~ContextOutput() {};
+
+    /// A function to write path-contexts of one file
+    /// @param res result of one file
+    virtual void write(const FileResult &res) = 0;
+
+    /// A function to finish the output, no more results are written after it
+    virtual void close() = 0;
+};
+
+/// Text output: one line "<name> <path-context> <path-context> ..." per file
+class TextOutput : public ContextOutput
+{
+    BufferedSink out;
+    /// Write path-contexts as <path id>_<hash> instead of the ready-made line
+    bool interned;
+
+  public:
+    /// @param file path to the output file
+    /// @param intern whether path-contexts are interned
+    /// @param header first line of the file, nothing if empty
+    TextOutput(const std::filesystem::path &file, bool intern, std::string_view header = {})
+        : out(file), interned(intern)
+    {
+        out.write(header);
+    }
+
+    void write(const FileResult &res) override;
+
+    void close() override;
+};
+
+/// Text output compressed in independent blocks, see CompressedFile.h
+/// @brief - lines are the same as TextOutput's ones, a line is never split between blocks
+class CompressedTextOutput : public ContextOutput
+{
+    CompressedFileWriter out;
+    /// Write path-contexts as <path id>_<hash> instead of the ready-made line
+    bool interned;
+
+  public:
+    /// @param file path to the output file
+    /// @param intern whether path-contexts are interned
+    /// @param workers pool compressing blocks, it's shared by all compressed outputs
+    /// @param header first line of the file, nothing if empty
+    CompressedTextOutput(const std::filesystem::path &file, bool intern, threadpool::ThreadPool &workers,
+                         std::string_view header = {})
+        : out(file, workers), interned(intern)
+    {
+        out.write(header);
+    }
+
+    void write(const FileResult &res) override;
+
+    void close() override;
+};
+
+/// Binary output, see ContextFile.h
+class BinaryOutput : public ContextOutput
+{
+    ContextFileWriter out;
+
+  public:
+    BinaryOutput(const std::filesystem::path &file, const treesitter::PathInterner &paths) : out(file, paths) {}
+
+    void write(const FileResult &res) override;
+
+    void close() override;
+};
+
+/// Output that makes another output deterministic
+/// @brief - results are spilled to a temporary file as they come, only their names and offsets stay in memory
+/// @brief - close() passes them to the wrapped output sorted by name, with paths renumbered in canonical order (see
+/// PathInterner::canonicalize), so the result doesn't depend on threads' scheduling
+/// @brief - files with the same name (e.g. in different subdirectories) are sorted by their relative paths
+class SortedOutput : public ContextOutput
+{
+    /// Location of one result in the spill file
+    struct Entry {
+        std::string name;
+        std::string source;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    /// Wrapped output
+    std::unique_ptr<ContextOutput> inner;
+    /// Source of the paths' ids
+    treesitter::PathInterner &paths;
+    /// Temporary file
+    std::filesystem::path spillFile;
+    BufferedSink spill;
+    /// Number of bytes spilled so far
+    uint64_t offset = 0;
+    /// Spilled results
+    std::vector<Entry> index;
+
+  public:
+    /// Constructor to wrap an output
+    /// @param out output to pass sorted results to
+    /// @param file path to the temporary file
+    /// @param interner source of the results' path ids
+    SortedOutput(std::unique_ptr<ContextOutput> out, const std::filesystem::path &file,
+                 treesitter::PathInterner &interner);
+
+    void write(const FileResult &res) override;
+
+    void close() override;
+};
+
+/// A function to get a portable hash of a file's name (FNV-1a), e.g. the same on every platform and compiler
+/// @param name name of a file
+/// @return hash of the name
+uint64_t nameHash(std::string_view name);
+
+/// Dedicated output stage of the extractor
+/// @brief - workers hand their results over a bounded multi-producer queue, so memory doesn't depend on the
+/// dataset size
+/// @brief - a single writer thread passes results to the outputs
+/// @brief - with several outputs (shards) a result goes to the shard nameHash(name) % number of shards
+class Writer
+{
+    /// Results waiting to be written
+    threadpool::ThreadSafeQueue<FileResult> results;
+    /// The same, if the writer uses a lock-free queue: the semaphores keep it from overflowing
+    std::optional<threadpool::MPMCRing<FileResult>> resultsRing;
+    /// Number of free places in the queue
+    std::counting_semaphore<> slots;
+    /// Number of results in the queue (plus one to signal the end of input)
+    std::counting_semaphore<> items{0};
+    /// Is the input over, it's set by close() once all producers are done
+    std::atomic_bool closing = false;
+    /// The first exception of the writer thread, later results are dropped, it's rethrown by close()
+    std::exception_ptr error;
+
+    /// Outputs with path-contexts
+    std::vector<std::unique_ptr<ContextOutput>> outputs;
+
+    /// Writer thread
+    std::jthread thread;
+
+    /// Main loop of the writer thread
+    void loop();
+
+  public:
+    /// Constructor to start the writer thread
+    /// @param outs outputs (shards) for path-contexts
+    /// @param capacity maximum number of results waiting in the queue
+    /// @param queue kind of the queue
+    Writer(std::vector<std::unique_ptr<ContextOutput>> outs, size_t capacity,
+           threadpool::QueueKind queue = threadpool::QueueKind::Locked);
+
+    Writer(const Writer &) = delete;
+
+    Writer &operator=(const Writer &) = delete;
+
+    /// A function to pass a result to the writer, blocks while the queue is full
+    /// @param res result of one file
+    void push(FileResult &&res);
+
+    /// A function to finish writing, should be called once all producers are done
+    /// @brief - waits until the queue is drained and closes the outputs
+    /// @brief - rethrows the first failure of a write, the outputs aren't closed then
+    void close();
+
+    ~Writer();
+};
+} // namespace extractor
+
+#endif
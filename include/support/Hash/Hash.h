@@ -0,0 +1,32 @@
+#ifndef SUPPORT_HASH_HASH_H
+#define SUPPORT_HASH_HASH_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace hashing
+{
+
+/// Name of the algorithm terminals and files are hashed with
+inline constexpr std::string_view algorithm = "xxh64";
+
+/// Seed used unless another one is given
+inline constexpr uint64_t defaultSeed = 0;
+
+/// A function to hash bytes with XXH64
+/// @brief - the value is defined by the algorithm only, so it's the same on every machine, compiler and standard
+/// library (unlike std::hash), hashes from different hosts can be merged
+/// @brief - works on a view, nothing is copied or allocated
+/// @param data bytes to hash
+/// @param seed seed of the hash
+/// @return 64-bit hash
+uint64_t xxh64(std::string_view data, uint64_t seed = defaultSeed);
+
+/// A function to describe hashes for an output's header
+/// @param seed seed of the hashes
+/// @return a line in format "#hash <algorithm> <seed>\n"
+std::string header(uint64_t seed);
+}; // namespace hashing
+
+#endif
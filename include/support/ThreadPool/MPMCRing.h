@@ -0,0 +1,164 @@
+#ifndef SUPPORT_THREADPOOL_MPMCRING_H
+#define SUPPORT_THREADPOOL_MPMCRING_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <thread>
+
+namespace threadpool
+{
+/// Kind of a queue shared by threads
+/// @brief - Locked is ThreadSafeQueue: unbounded, every operation takes a mutex
+/// @brief - LockFree is MPMCRing: bounded, no locks
+enum class QueueKind { Locked, LockFree };
+
+/// Bounded multi-producer multi-consumer queue without locks (Vyukov's ring)
+/// @brief - every cell has a sequence number telling whether it's free for the push of a position or filled for the
+/// pop of a position, a thread claims a position with one CAS and publishes the cell with one store
+/// @brief - positions and cells are on their own cache lines, so producers and consumers don't invalidate each other
+/// @brief - the interface is the one of ThreadSafeQueue, push waits while the ring is full
+/// @tparam T type of the values
+template <typename T> class MPMCRing
+{
+    static constexpr size_t cacheLine = 64;
+
+    /// A place for a value
+    struct alignas(cacheLine) Cell {
+        /// position + 1 if the cell is filled for the pop of position, position if it's free for its push
+        std::atomic_size_t sequence;
+        alignas(T) std::byte storage[sizeof(T)];
+
+        T *
+        value()
+        {
+            return std::launder(reinterpret_cast<T *>(storage));
+        }
+    };
+
+    /// capacity - 1, the capacity is a power of 2
+    size_t mask;
+    /// Cells of the ring
+    std::unique_ptr<Cell[]> cells;
+    /// Position of the next push
+    alignas(cacheLine) std::atomic_size_t tail = 0;
+    /// Position of the next pop
+    alignas(cacheLine) std::atomic_size_t head = 0;
+
+  public:
+    /// @param capacity maximum number of values, rounded up to a power of 2
+    explicit MPMCRing(size_t capacity = 1024)
+        : mask(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1), cells(new Cell[mask + 1])
+    {
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPMCRing(const MPMCRing &) = delete;
+
+    MPMCRing &operator=(const MPMCRing &) = delete;
+
+    ~MPMCRing()
+    {
+        // values left in the ring are destroyed
+        while (pop()) {
+        }
+    }
+
+    /// A function to add a value unless the ring is full
+    /// @param value the value, it's moved from only if it was added
+    /// @return whether the value was added
+    bool
+    tryPush(T &&value)
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (cell.storage) T(std::move(value));
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                // the cell still holds the value pushed a lap ago
+                return false;
+            } else {
+                // another producer took the position
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// A function to add a value, it waits while the ring is full
+    /// @param value the value
+    void
+    push(T &&value)
+    {
+        while (!tryPush(std::move(value))) {
+            std::this_thread::yield();
+        }
+    }
+
+    /// A function to remove the oldest value
+    /// @return the value, nothing if the ring is empty
+    std::optional<T>
+    pop()
+    {
+        size_t pos = head.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = intptr_t(seq) - intptr_t(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    std::optional<T> res(std::move(*cell.value()));
+                    cell.value()->~T();
+                    // the cell is free for the push a lap later
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return res;
+                }
+            } else if (diff < 0) {
+                // the cell isn't filled yet
+                return std::nullopt;
+            } else {
+                // another consumer took the position
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// @return whether the ring is empty, it may be outdated once returned
+    bool
+    empty() const
+    {
+        return size() == 0;
+    }
+
+    /// @return number of values in the ring, it may be outdated once returned
+    size_t
+    size() const
+    {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return t > h ? t - h : 0;
+    }
+
+    /// @return maximum number of values
+    size_t
+    capacity() const
+    {
+        return mask + 1;
+    }
+};
+}; // namespace threadpool
+
+#endif
@@ -2,87 +2,254 @@
 #define SUPPORT_THREADPOOL_THREADPOOL_H
 
 #include <support/ThreadPool/ThreadSafeQueue.h>
+#include <support/ThreadPool/MPMCRing.h>
+#include <support/ThreadPool/WorkStealingDeque.h>
 #include <vector>
 #include <functional>
 #include <thread>
 #include <future>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <optional>
+#include <ranges>
+#include <type_traits>
 
 namespace threadpool
 {
 
+/// Pool of workers that run tasks
+/// @brief - every worker has its own work-stealing deque: tasks submitted by a task go to the bottom of its worker's
+/// deque without locks, an idle worker steals from the top of a randomly chosen worker's deque
+/// @brief - tasks submitted by threads outside the pool go to a shared queue, a bounded pool may use a lock-free one
+/// @brief - idle workers sleep until the next submission, the destructor waits for all tasks, including the ones
+/// submitted while it waits
+/// @brief - many small tasks should be submitted as one batch, it costs one task per chunk of elements
+/// @brief - a task's result, or the exception it threw, is passed to the caller through the task's future
+/// @brief - a bounded pool keeps at most capacity tasks waiting: a thread outside the pool waits for a free place (or
+/// gives up with tryAddTask), a worker runs its task itself, so workers never wait for each other
 class ThreadPool
 {
-    // Task package for each thread
-    struct Task {
-        // queue of tasks for each worker
-        ThreadSafeQueue<std::move_only_function<void()>> tasks{};
-        // semaphore to allow only one worker in a critical section
-        std::binary_semaphore semaphore{0};
+    // Number of chunks a batch is split into per worker by default, a few of them let workers balance uneven elements
+    static constexpr size_t chunksPerWorker = 4;
+
+    // a task, it's owned by the queue it's in
+    using Job = std::move_only_function<void()>;
+
+    // type of the result of f(args...) called by a task, arguments are stored in the task
+    template <typename Func, typename... Args> using Result = std::invoke_result_t<Func &, Args &...>;
+
+    // Task package for each worker
+    struct Worker {
+        // tasks submitted by the worker itself
+        WorkStealingDeque<Job> deque;
     };
 
     // vector[numThreads] storing threads corresponding to workers
     std::vector<std::jthread> threads;
-    // vector[numThreads] for each worker storing it's Task package, e.g. its own semaphore and tasks queue
-    std::vector<Task> tasks;
-    // vector with workers' ids
-    ThreadSafeQueue<size_t> workers;
-
-    // The counter for tasks waiting in a queue
-    std::atomic_int waitingTasks = 0;
-    // The counter for tasks left for processing in total
-    std::atomic_int totalLeftTasks = 0;
-    // The flag which signals if threadpool can be stopped
-    std::atomic_bool doneThreads = false;
+    // vector[numThreads] for each worker storing its Task package
+    std::vector<Worker> workers;
+    // tasks submitted by threads outside the pool
+    ThreadSafeQueue<Job *> injected;
+    // the same, if the pool uses a lock-free queue: it never overflows since the pool is bounded
+    std::optional<MPMCRing<Job *>> injectedRing;
+    // number of tasks in injected, workers don't lock it when it's empty
+    std::atomic_size_t numInjected = 0;
+
+    // The counter for tasks submitted, but not finished yet
+    std::atomic_size_t leftTasks = 0;
+    // The counter of submissions, idle workers wait for it to change
+    std::atomic_uint32_t wakeups = 0;
+    // The counter for workers waiting for a submission
+    std::atomic_int sleeping = 0;
+    // The flag which signals that workers should exit
+    std::atomic_bool stopping = false;
+
+    // Maximum number of tasks waiting to be run, 0 if unbounded
+    size_t capacity;
+    // The counter for tasks waiting to be run, it's counted only if the pool is bounded
+    std::atomic_size_t waiting = 0;
+    // The counter for threads waiting for a free place
+    std::atomic_int blocked = 0;
+
+    // @return index of the calling thread's worker if it's a worker of this pool, workers.size() otherwise
+    size_t self() const;
+
+    // A function to take a place for a task in a bounded pool
+    // @param wait whether to wait for a free place if the pool is full
+    // @return whether the place was taken
+    bool reserve(bool wait);
+
+    // A function to pass a task to a worker
+    // @param wait whether a thread outside the pool waits for a free place if the pool is full
+    // @return false if the pool is full and the task was dropped
+    bool submit(Job *job, bool wait = true);
+
+    // A function to find a task for the i'th worker: its own newest one, a task from outside, an oldest one of others
+    Job *find(size_t i, uint64_t &random);
+
+    // A function to run a task and free it
+    void run(Job *job);
+
+    // The loop of the i'th worker
+    void work(size_t i);
+
+    // A function to make a task that calls f(args...) and passes its result or exception to the promise
+    template <typename R, typename Func, typename... Args>
+    static Job *
+    makeJob(std::promise<R> promise, Func f, Args... args)
+    {
+        return new Job([func = std::move(f), ... largs = std::move(args), promise = std::move(promise)]() mutable {
+            try {
+                if constexpr (std::is_void_v<R>) {
+                    std::invoke(func, largs...);
+                    promise.set_value();
+                } else {
+                    promise.set_value(std::invoke(func, largs...));
+                }
+            } catch (...) {
+                // the worker goes on, the caller gets the exception from the future
+                promise.set_exception(std::current_exception());
+            }
+        });
+    }
 
   public:
-    explicit ThreadPool(size_t numThreads = 1);
+    /// @param numThreads number of workers
+    /// @param capacity maximum number of tasks waiting to be run, 0 if unbounded
+    /// @param queue kind of the queue of tasks submitted from outside, a lock-free one needs a bounded pool
+    explicit ThreadPool(size_t numThreads = 1, size_t capacity = 0, QueueKind queue = QueueKind::Locked);
 
     ThreadPool(const ThreadPool &) = delete;
 
     ThreadPool &operator=(const ThreadPool &) = delete;
 
+    /// @return number of workers
+    size_t
+    numThreads() const
+    {
+        return workers.size();
+    }
+
+    /// A function to submit a task calling f(args...)
+    /// @param f callable
+    /// @param args arguments, they are copied (or moved) into the task
+    /// @return future of the result of f, it rethrows the exception f threw
     template <typename Func, typename... Args>
-    std::future<void>
+    std::future<Result<Func, Args...>>
     addTask(Func f, Args... args)
     {
         // define the promise
-        std::promise<void> promise;
+        std::promise<Result<Func, Args...>> promise;
 
         // get the future
         auto fut = promise.get_future();
 
-        // get worker's idx i from the beginning of the queue
-        auto val = workers.pop();
-        if (!val.has_value()) {
+        if (workers.empty()) {
             return fut;
         }
 
-        auto i = val.value();
+        submit(makeJob(std::move(promise), std::move(f), std::move(args)...));
+
+        return fut;
+    }
+
+    /// A function to submit a task unless the pool is full
+    /// @brief - unlike addTask it never waits and never runs the task itself
+    /// @return future of the task, nothing if the pool is full
+    template <typename Func, typename... Args>
+    std::optional<std::future<Result<Func, Args...>>>
+    tryAddTask(Func f, Args... args)
+    {
+        std::promise<Result<Func, Args...>> promise;
+        auto fut = promise.get_future();
 
-        // move this worker to the queue's back
-        workers.push(size_t(val.value()));
+        if (workers.empty()) {
+            return fut;
+        }
 
-        // at the beginning
-        if (totalLeftTasks == 0) {
-            doneThreads.store(false, std::memory_order_release);
+        if (!submit(makeJob(std::move(promise), std::move(f), std::move(args)...), false)) {
+            return std::nullopt;
         }
+        return fut;
+    }
 
-        // increase counters
-        totalLeftTasks.fetch_add(1, std::memory_order_release);
-        waitingTasks.fetch_add(1, std::memory_order_release);
+    /// A function to run a callable on every element of a range, the range is split into chunks run by different tasks
+    /// @brief - a chunk costs one task, the whole batch costs one promise and one future
+    /// @param range random access range, the batch keeps it until all elements are processed
+    /// @param f callable getting an element
+    /// @param grain number of elements in a chunk, 0 picks a few chunks per worker
+    /// @return future that is ready once all elements are processed, it rethrows the first exception f threw, the
+    /// rest of the chunk that threw is skipped
+    /// @brief - every chunk is submitted like addTask does, so a bounded pool may block the caller between chunks
+    template <std::ranges::random_access_range Range, typename Func>
+        requires std::ranges::sized_range<Range>
+    std::future<void>
+    addBatch(Range range, Func f, size_t grain = 0)
+    {
+        struct Batch {
+            Range range;
+            Func func;
+            std::atomic_size_t leftChunks;
+            std::promise<void> promise;
+            // the first exception, it's set by the chunk that raised the flag
+            std::atomic_flag failed;
+            std::exception_ptr error;
+        };
 
-        // add task to the queue
-        tasks[i].tasks.push(
-            std::move([func = std::move(f), ... largs = std::move(args), promise = std::move(promise)]() mutable {
-                func(largs...);
-                promise.set_value();
-            }));
+        size_t size = std::ranges::size(range);
+        auto batch = std::make_shared<Batch>(std::move(range), std::move(f), 0);
+        auto fut = batch->promise.get_future();
 
-        // release semaphore
-        tasks[i].semaphore.release();
+        if (workers.empty()) {
+            return fut;
+        }
+        if (size == 0) {
+            batch->promise.set_value();
+            return fut;
+        }
+        if (grain == 0) {
+            grain = std::max<size_t>(1, size / (chunksPerWorker * workers.size()));
+        }
+        batch->leftChunks = (size + grain - 1) / grain;
 
+        for (size_t first = 0; first < size; first += grain) {
+            submit(new Job([batch, first, last = std::min(size, first + grain)] {
+                try {
+                    auto begin = std::ranges::begin(batch->range);
+                    for (size_t i = first; i < last; ++i) {
+                        batch->func(begin[i]);
+                    }
+                } catch (...) {
+                    if (!batch->failed.test_and_set(std::memory_order_relaxed)) {
+                        batch->error = std::current_exception();
+                    }
+                }
+                // the last chunk completes the batch
+                if (batch->leftChunks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    if (batch->error) {
+                        batch->promise.set_exception(batch->error);
+                    } else {
+                        batch->promise.set_value();
+                    }
+                }
+            }));
+        }
         return fut;
     }
+
+    /// A function to run a callable on every index of [0, n), see addBatch
+    /// @param n number of indices
+    /// @param f callable getting an index
+    /// @param grain number of indices in a chunk, 0 picks a few chunks per worker
+    /// @return future that is ready once all indices are processed
+    template <typename Func>
+    std::future<void>
+    parallelFor(size_t n, Func f, size_t grain = 0)
+    {
+        return addBatch(std::views::iota(size_t(0), n), std::move(f), grain);
+    }
+
     ~ThreadPool();
 };
 }; // namespace threadpool
@@ -0,0 +1,136 @@
+#ifndef SUPPORT_THREADPOOL_WORKSTEALINGDEQUE_H
+#define SUPPORT_THREADPOOL_WORKSTEALINGDEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace threadpool
+{
+/// Chase-Lev work-stealing deque of pointers
+/// @brief - the owner pushes and takes at the bottom (LIFO), other threads steal at the top (FIFO), nothing is locked
+/// @brief - the buffer grows when it's full, old buffers are kept until the deque is destroyed since a thief may still
+/// read them
+/// @brief - the deque doesn't own the pointed values
+/// @tparam T type of the pointed values
+template <typename T> class WorkStealingDeque
+{
+    /// Circular buffer, its capacity is a power of 2
+    struct Buffer {
+        size_t mask;
+        std::unique_ptr<std::atomic<T *>[]> slots;
+
+        explicit Buffer(size_t capacity) : mask(capacity - 1), slots(new std::atomic<T *>[capacity]) {}
+
+        T *
+        get(int64_t i) const
+        {
+            return slots[i & mask].load(std::memory_order_relaxed);
+        }
+
+        void
+        put(int64_t i, T *value)
+        {
+            slots[i & mask].store(value, std::memory_order_relaxed);
+        }
+    };
+
+    /// Index of the next value to steal, thieves' end
+    alignas(64) std::atomic<int64_t> top = 0;
+    /// Index after the last pushed value, owner's end
+    alignas(64) std::atomic<int64_t> bottom = 0;
+    /// The current buffer
+    std::atomic<Buffer *> buffer;
+    /// All buffers, only the owner changes it
+    std::vector<std::unique_ptr<Buffer>> buffers;
+
+  public:
+    /// @param capacity initial capacity, a power of 2
+    explicit WorkStealingDeque(size_t capacity = 1024)
+    {
+        buffers.push_back(std::make_unique<Buffer>(capacity));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    /// A function to add a value at the bottom, only the owner may call it
+    /// @param value the value
+    void
+    push(T *value)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+        if (b - t > int64_t(buf->mask)) {
+            // full: values [t, b) are copied to a buffer twice as large
+            buffers.push_back(std::make_unique<Buffer>(2 * (buf->mask + 1)));
+            auto grown = buffers.back().get();
+            for (int64_t i = t; i < b; ++i) {
+                grown->put(i, buf->get(i));
+            }
+            buffer.store(grown, std::memory_order_release);
+            buf = grown;
+        }
+        buf->put(b, value);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    /// A function to remove the last pushed value, only the owner may call it
+    /// @return the value or nullptr if the deque is empty
+    T *
+    take()
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            // empty
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *value = buf->get(b);
+        if (t == b) {
+            // the last value, thieves may race for it
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                value = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return value;
+    }
+
+    /// A function to remove the first pushed value, any thread may call it
+    /// @return the value or nullptr if the deque is empty or another thread has taken the value first
+    T *
+    steal()
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        T *value = buffer.load(std::memory_order_acquire)->get(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return value;
+    }
+
+    /// @return whether the deque looks empty, the answer may be outdated once it's returned
+    bool
+    empty() const
+    {
+        return top.load(std::memory_order_relaxed) >= bottom.load(std::memory_order_relaxed);
+    }
+};
+}; // namespace threadpool
+
+#endif
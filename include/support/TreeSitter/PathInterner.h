@@ -0,0 +1,115 @@
+#ifndef SUPPORT_TREESITTER_PATHINTERNER_H
+#define SUPPORT_TREESITTER_PATHINTERNER_H
+
+#include <support/TreeSitter/TreeSitter.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace treesitter
+{
+
+/// Class that assigns dense ids to distinct sequences of grammar symbols
+/// @brief - sequences are stored in a trie: each trie node is a (parent, symbol) pair, so common prefixes are shared
+/// and every node is created once (hash-consing)
+/// @brief - a path gets its id the first time it's interned, ids are 0, 1, 2, ...
+/// @brief - the interner is thread-safe: the trie is split into shards with their own locks, lookups of existing
+/// nodes take a shared lock only
+class PathInterner
+{
+  public:
+    /// Value meaning "no id yet"
+    static constexpr uint32_t none = UINT32_MAX;
+
+    /// Trie node, e.g. a prefix of some path
+    struct Node {
+        /// previous node of the path, nullptr for the root
+        const Node *parent;
+        /// grammar symbol of the last node of the prefix
+        TSSymbol symbol;
+        /// length of the prefix
+        uint32_t depth;
+        /// id of the path ending at this node, if any
+        mutable std::atomic<uint32_t> path{none};
+
+        Node(const Node *p, TSSymbol s, uint32_t d) : parent(p), symbol(s), depth(d) {}
+    };
+
+  private:
+    /// Number of shards, a power of 2
+    static constexpr size_t numShards = 64;
+
+    /// One part of the trie
+    struct alignas(64) Shard {
+        std::shared_mutex m;
+        /// (parent, symbol) -> node
+        std::unordered_map<uint64_t, Node> nodes;
+    };
+
+    std::array<Shard, numShards> shards;
+
+    /// Empty prefix
+    Node rootNode{nullptr, 0, 0};
+
+    /// Lock for assigning paths' ids
+    mutable std::mutex pathsMutex;
+    /// Path id -> the node it ends at
+    std::vector<const Node *> paths;
+    /// Old path id -> canonical one, filled by canonicalize()
+    std::vector<uint32_t> canonical;
+
+    /// @param node the last node of a path
+    /// @return grammar symbols of the path from its first node to the last one
+    static std::vector<TSSymbol> symbols(const Node *node);
+
+  public:
+    PathInterner() = default;
+
+    PathInterner(const PathInterner &) = delete;
+
+    PathInterner &operator=(const PathInterner &) = delete;
+
+    /// @return the empty prefix
+    const Node *root() const;
+
+    /// A function to extend a prefix with one symbol
+    /// @param parent a prefix
+    /// @param symbol grammar symbol of the next node
+    /// @return the extended prefix, created if needed
+    const Node *child(const Node *parent, TSSymbol symbol);
+
+    /// A function to get the id of the path ending at a given node
+    /// @param node the last node of a path
+    /// @return the path's id, assigned if the path is new
+    uint32_t pathId(const Node *node);
+
+    /// A function to intern a tokenized path-context
+    /// @param pathContext a vector of tokens
+    /// @return the path's id
+    uint32_t intern(std::span<const TokenizedToken> pathContext);
+
+    /// A function to renumber paths in order of their symbols, so ids don't depend on threads' scheduling
+    /// @brief - should be called once all paths are interned, later calls return the same mapping
+    /// @return old id -> new id
+    const std::vector<uint32_t> &canonicalize();
+
+    /// @return number of distinct paths
+    size_t size() const;
+
+    /// @param id id of a path
+    /// @return grammar symbols of the path from its first node to the last one
+    std::vector<TSSymbol> symbols(uint32_t id) const;
+
+    /// @param id id of a path
+    /// @return a string representation of the path in format idid...id (the same as Split::toPath)
+    std::string toString(uint32_t id) const;
+};
+}; // namespace treesitter
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef SUPPORT_TREESITTER_SCRATCHARENA_H
+#define SUPPORT_TREESITTER_SCRATCHARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+namespace treesitter
+{
+
+/// Monotonic arena with its own first block
+struct Arena {
+    /// Size of the first block
+    static constexpr size_t initialSize = 1 << 20;
+
+    /// The first block
+    std::unique_ptr<std::byte[]> block{new std::byte[initialSize]};
+    /// Allocations start in the block and continue on the heap
+    std::pmr::monotonic_buffer_resource resource{block.get(), initialSize};
+};
+
+/// Scratch memory of the file being processed by the calling thread
+/// @brief - every thread owns one arena, stacks, indices and vocabularies of a file are allocated from it and never
+/// freed one by one, the whole arena is released at once when the file is done
+/// @brief - the first block is reused from file to file, larger files take more blocks from the heap until the release
+/// @brief - a thread processes one file at a time, so arenas are never nested
+class ScratchArena
+{
+    /// Arena of the calling thread, nullptr once it's detached
+    std::unique_ptr<Arena> &arena;
+
+  public:
+    /// Constructor to take the arena of the calling thread
+    ScratchArena();
+
+    ScratchArena(const ScratchArena &) = delete;
+
+    ScratchArena &operator=(const ScratchArena &) = delete;
+
+    /// @return memory resource of the arena
+    std::pmr::memory_resource *
+    resource() const
+    {
+        return &arena->resource;
+    }
+
+    /// A function to hand the arena over to data that outlives the file's scope (e.g. a tree shared by other workers)
+    /// @brief - nothing is released, the thread takes a new arena for its next file
+    /// @return the arena, it must outlive everything allocated from it
+    std::unique_ptr<Arena>
+    detach()
+    {
+        return std::move(arena);
+    }
+
+    /// Destructor to release everything allocated since the arena was taken
+    ~ScratchArena();
+};
+}; // namespace treesitter
+
+#endif
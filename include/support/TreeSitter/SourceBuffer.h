@@ -0,0 +1,60 @@
+#ifndef SUPPORT_TREESITTER_SOURCEBUFFER_H
+#define SUPPORT_TREESITTER_SOURCEBUFFER_H
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+namespace treesitter
+{
+
+/// Read-only content of a source file
+/// @brief - files larger than mmapThreshold are mapped into memory, so their content is never copied
+/// @brief - smaller files are read into a string with one read(), it's cheaper than setting up a mapping
+/// @brief - a file that can't be opened gives an empty buffer
+class SourceBuffer
+{
+    /// Content of the file
+    const char *ptr = nullptr;
+    /// Size of the content
+    size_t len = 0;
+    /// Is ptr a mapping
+    bool mapped = false;
+    /// Storage of a file that was read
+    std::string storage;
+
+    /// A function to release the mapping, if any
+    void release();
+
+  public:
+    /// Minimal size of a file to be mapped
+    static constexpr size_t mmapThreshold = 16 << 10;
+
+    /// Constructor of an empty buffer
+    SourceBuffer() = default;
+
+    /// Constructor to load a file
+    /// @param file path to a source file
+    explicit SourceBuffer(const std::filesystem::path &file);
+
+    SourceBuffer(const SourceBuffer &) = delete;
+
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+    SourceBuffer(SourceBuffer &&other) noexcept;
+
+    SourceBuffer &operator=(SourceBuffer &&other) noexcept;
+
+    /// @return content of the file
+    std::string_view
+    view() const
+    {
+        return {ptr, len};
+    }
+
+    ~SourceBuffer();
+};
+}; // namespace treesitter
+
+#endif
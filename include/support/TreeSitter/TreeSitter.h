@@ -16,6 +16,24 @@
 #include <cstdint>
 #include <fstream>
 #include <sstream>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <span>
+#include <numeric>
+#include <filesystem>
+#include <memory_resource>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <shared_mutex>
+#include <support/TreeSitter/SourceBuffer.h>
+#include <support/Profiler/Profiler.h>
+#include <support/Hash/Hash.h>
 
 namespace treesitter
 {
@@ -27,13 +45,33 @@ extern "C" const TSLanguage *tree_sitter_c();
 extern "C" const TSLanguage *tree_sitter_cpp();
 
 /// Struct that represents one node
+/// @brief - it's trivially copyable, the textual id of the symbol is looked up in a SymbolEncoding when a path is split
 struct TokenizedToken {
-    /// grammar identifier of a node
-    std::string id;
     /// value or grammar type (hashed)
     size_t name;
+    /// grammar symbol of a node
+    TSSymbol symbol;
 };
 
+/// Grammar symbol of the marker a leaf-to-leaf path has right before its LCA, e.g. where the path turns from going up
+/// to going down, so paths with the same symbols but another turn are different paths
+/// @brief - no grammar has that many symbols, tree-sitter itself takes 65535 and 65534 for errors
+inline constexpr TSSymbol turnSymbol = 65533;
+
+/// Vocabulary of one file (hash -> terminal's name), allocated from the file's scratch memory
+using FileVocabulary = std::pmr::unordered_map<size_t, std::pmr::string>;
+
+/// Struct that represents one path-context split into the path and its terminals
+struct PathContext {
+    /// id of the path in a PathInterner
+    uint32_t path;
+    /// hash of the first terminal of a leaf-to-leaf path, 0 if the path starts at the root
+    size_t from;
+    /// hash of the (last) terminal
+    size_t terminal;
+};
+
+
 class TreeSitterNode
 {
   private:
@@ -87,59 +125,153 @@ class TreeSitterNode
     bool isFork() const;
 };
 
+/// Requirements to a traversal's consumer
+/// @brief - a traversal keeps the current path as a stack: nodes are entered on the way down and left on the way up,
+/// so a consumer can do per-node work once per node instead of once per path
+/// @brief - pathFound() is called every time the current path is a complete path-context
+template <typename T>
+concept PathVisitor = requires(T visitor, const TSNode &node) {
+    visitor.enter(node);
+    visitor.leave();
+    visitor.pathFound();
+};
+
+/// Concept of a consumer of path-contexts that memoizes whole subtrees (see SubtreeMemo)
+/// @brief - splice(hash, vocab) is called before the paths of a subtree are streamed, it returns true if the consumer
+/// has taken the subtree's paths from its memo and added their terminals to the vocabulary, the subtree is skipped then
+/// @brief - open(hash) returns true if the consumer records the paths of the subtree streamed until close(terminals),
+/// which gets the vocabulary entries of their terminals
+template <typename T>
+concept FragmentConsumer = requires(T consumer, uint64_t hash, FileVocabulary &vocab,
+                                    std::span<const std::pair<size_t, std::string_view>> terminals) {
+    { consumer.splice(hash, vocab) } -> std::same_as<bool>;
+    { consumer.open(hash) } -> std::same_as<bool>;
+    consumer.close(terminals);
+};
+
 /// Class that stores traversal policies
 /// @brief - This class defines the way the executor traverses the tree and what is considered to be a path-context
 /// @brief - Extracted path-contexts are not checked for correctness, e.g. the final sequence of path-contexts can be
 /// changed
+/// @brief - Paths are never materialized, they are streamed to a PathVisitor, so memory is O(depth of the tree)
 class Traversal
 {
-    /// A function to get all possible node-terminal (or terminal-node) sequences for a node
-    /// @param node a given node
-    /// @param reverseArr reverse the resulting vector if needed
-    /// @return vector of nodes' sequences
-    static std::vector<std::vector<TSNode>> getAllNode2TerminalPaths(const TSNode &node, bool reverseArr = false);
-
   public:
-    /// A function to get all possible root-terminal @note sequences
+    /// A function to stream all root-terminal @note sequences
     /// @param root the root of a tree
-    /// @return vector of sequences of nodes
-    static std::vector<std::vector<TSNode>> root2terminal(const TSNode &root);
+    /// @param visitor consumer of the paths
+    template <PathVisitor Visitor>
+    static void
+    root2terminal(const TSNode &root, Visitor &visitor)
+    {
+        TSTreeCursor cursor = ts_tree_cursor_new(root);
+        visitor.enter(ts_tree_cursor_current_node(&cursor));
+        uint64_t visited = 1;
 
-    /// A function to get all possible terminal-terminal @note sets
-    /// @param root the root of a tree
-    /// @return vector of sequences of nodes
-    static std::vector<std::vector<TSNode>> terminal2terminal(const TSNode &root);
+        int isNew = true;
+
+        while (1) {
+            if (isNew && ts_tree_cursor_goto_first_child(&cursor)) {
+                // to child (down)
+                visitor.enter(ts_tree_cursor_current_node(&cursor));
+                ++visited;
+            } else {
+                // terminal || !isNew
+                if (isNew) {
+                    // terminal -> the current path is a root-terminal path
+                    visitor.pathFound();
+                }
+                if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+                    // to sibling terminal (up-down)
+                    visitor.leave();
+                    isNew = true;
+                    visitor.enter(ts_tree_cursor_current_node(&cursor));
+                    ++visited;
+                } else if (ts_tree_cursor_goto_parent(&cursor)) {
+                    // to parent (up)
+                    isNew = false;
+                    visitor.leave();
+                } else {
+                    visitor.leave();
+                    break;
+                }
+            }
+        }
+
+        ts_tree_cursor_delete(&cursor);
+        profiler::count(profiler::Counter::NodesVisited, visited);
+    }
 };
 
 /// Class that stores tokenization methods
-/// @brief - Each method checks if a sequence of nodes is correct according to some rules (e.g. to get rid of comments,
+/// @brief - Each token is assigned a pair (id, token) (TokenizedToken struct) based on some inner logic, once per
+/// node when the node is entered
+/// @brief - Each filter checks if a sequence of nodes is correct according to some rules (e.g. to get rid of comments,
 /// #includes etc.)
-/// @brief - Each token is assigned a pair (id, token) (TokenizedToken struct) based on some inner logic
-/// @brief - Each method returns a "correct" path-context or std::nullopt
 class Tokenizer
 {
   public:
-    /// A function that collects information (id, name) about a particular node
-    /// @brief - remove comments (and other TreeSitter extra nodes)
-    /// @brief - remove too short branches (e.g. #define, #include)
+    /// Seed of terminals' hashes, should only be changed before the extraction starts
+    static inline uint64_t seed = hashing::defaultSeed;
+
+    /// A function that collects information (symbol, name) about a particular node
     /// @brief - all non-terminals don't have names
     /// @brief - all named terminals (e.g. terminals that exist in the grammar) excluding identifiers are passed by
     /// value
     /// @brief - all identifiers (e.g. variables) and unnamed terminals are passed by grammar type
-    /// @brief - all terminals' names are hashed (to avoid spaces in strings etc.)
+    /// @brief - all terminals' names are hashed with xxh64 and the seed (to avoid spaces in strings etc.), so the
+    /// hashes are the same on every machine
     /// @param node a given node
     /// @param src file' context (required to extract exact values)
-    /// @param vocab a vocabulary that stores mapping between terminal names and their hashes
+    /// @param text a terminal's vocabulary entry, untouched for non-terminals
     /// @return TokenizedToken
-    static std::optional<std::vector<TokenizedToken>>
-    defaultTokenization(const std::vector<TSNode> &node, const std::string &src,
-                        std::unordered_map<size_t, std::string> &vocab);
+    static TokenizedToken defaultToken(const TSNode &node, std::string_view src, std::pmr::string &text);
+
+    /// A function that checks if a terminal may be an end of a path-context
+    /// @brief - remove comments (and other TreeSitter extra nodes)
+    /// @param node a terminal
+    /// @return whether the terminal is kept
+    static bool defaultTerminal(const TSNode &node);
+
+    /// A function that checks if a path is a correct path-context
+    /// @brief - remove comments (and other TreeSitter extra nodes)
+    /// @brief - remove too short branches (e.g. #define, #include)
+    /// @param nodes nodes of a path
+    /// @return whether the path is kept
+    static bool defaultFilter(std::span<const TSNode> nodes);
+};
+
+/// Class that stores textual encodings of the grammar symbols of a language
+/// @brief - a symbol is encoded as its 3-formatted grammar id (e.g. "007"), the table is computed once per language
+/// from ts_language_symbol_count, so nothing is formatted per node
+class SymbolEncoding
+{
+    /// Encodings of all symbols one after another
+    std::string chars;
+    /// chars[offsets[s], offsets[s + 1]) is the encoding of the symbol s
+    std::vector<uint32_t> offsets;
+
+    explicit SymbolEncoding(const TSLanguage *lang);
+
+  public:
+    /// A function to get the table of a language
+    /// @param lang a language
+    /// @return the table, it's built on the first call and lives until the program exits
+    static const SymbolEncoding &of(const TSLanguage *lang);
+
+    /// @param symbol a grammar symbol of the language
+    /// @return encoding of the symbol
+    std::string_view
+    operator[](TSSymbol symbol) const
+    {
+        return {chars.data() + offsets[symbol], offsets[symbol + 1] - offsets[symbol]};
+    }
 };
 
 /// Class that stores split strategies
 /// @brief - By that time each path-context (a sequence of tokenized tokens) is considered to be correct
 /// @brief - Methods from this class just decorate each path-context (e.g, make  a sequence of tokens be separated with
-/// ",")
+/// ","), the result is appended to a buffer the caller keeps between path-contexts
 class Split
 {
   public:
@@ -148,83 +280,871 @@ class Split
     /// @brief - <id> is a 3-formatted grammar id of a node,
     /// @brief - "_" is an underscore, which divides the path and the terminal,
     /// @brief - <hash> is a hash value of a terminal
+    /// @param symbols encodings of the tokens' symbols
+    /// @param pathContext a vector of tokens to process
+    /// @param out buffer to append a string representation of tokens in format idid...id_hash to (e.g.
+    /// 123423678_276187 implies a sequence of nodes "123", "423", "678" where "678" is a terminal with hash 276187)
+    static void toBranch(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext,
+                         std::string &out);
+
+    /// A function that converts a sequence of tokens to the path part of a branch, e.g. without the terminal
+    /// @brief - the turn of a leaf-to-leaf path (see turnSymbol) is written as "^" right before the LCA's id
+    /// @param symbols encodings of the tokens' symbols
     /// @param pathContext a vector of tokens to process
-    /// @return a string representation of tokens in format idid...id_hash (e.g. 123423678_276187 implies a sequence of
-    /// nodes "123", "423", "678" where "678" is a terminal with hash 276187)
-    static std::string toBranch(const std::vector<TokenizedToken> &pathContext);
+    /// @param out buffer to append a string representation of tokens in format idid...id to
+    static void toPath(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext,
+                       std::string &out);
+
+    /// A function that converts a sequence of tokens to a string representing a path between two terminals
+    /// @brief - each path is represented as <hash>_<id>...<id>^<id>...<id>_<hash>, e.g. both terminals are kept and
+    /// "^" precedes the LCA
+    /// @param symbols encodings of the tokens' symbols
+    /// @param pathContext a vector of tokens to process
+    /// @param out buffer to append a string representation of tokens in format hash_idid...id_hash to
+    static void toContext(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext,
+                          std::string &out);
+};
+
+/// Struct that represents one supported language
+struct Language {
+    /// index in LanguageRegistry::all()
+    size_t id;
+    /// option of the language
+    std::string_view name;
+    /// grammar the language's files are parsed with
+    const TSLanguage *(*grammar)();
+    /// extensions of the language's files
+    std::span<const std::string_view> extensions;
 };
 
-/// Mapping between options and language callables
-static std::unordered_map<std::string, std::function<const TSLanguage *(void)>> languages = {
-    {"c", std::bind(tree_sitter_c)}, {"cpp", std::bind(tree_sitter_cpp)}};
+/// Class that stores supported languages, the only place that maps options and files to grammars
+/// @brief - parsers aren't shared between languages, every thread keeps one parser per language (see ParserCache), so
+/// files of different languages can be mixed in one run
+class LanguageRegistry
+{
+  public:
+    /// @return all supported languages
+    static std::span<const Language> all();
+
+    /// A function to find a language by its option
+    /// @param name option of the language
+    /// @return the language, throws if it's unknown
+    static const Language &byName(std::string_view name);
+
+    /// A function to detect a language of a file by its extension
+    /// @param file path to the file
+    /// @return the language or nullptr if the extension is unknown
+    static const Language *byExtension(const std::filesystem::path &file);
+};
+
+/// Visitor that tokenizes the current path incrementally
+/// @brief - a node is tokenized once, when it's entered, its token lives on the stack while the node is on the path
+/// @brief - a terminal is added to the vocabulary only if a path ending at it passes the filter
+/// @brief - the stacks are allocated from the vocabulary's memory resource
+template <typename TokenizationPolicy, typename Emit> class TokenizingVisitor
+{
+    std::string_view src;
+    FileVocabulary &vocab;
+    Emit &emit;
+
+    /// Nodes of the current path
+    std::pmr::vector<TSNode> nodes;
+    /// Tokens of the current path
+    std::pmr::vector<TokenizedToken> tokens;
+    /// Vocabulary entry of the last entered terminal
+    std::pmr::string text;
+
+  public:
+    TokenizingVisitor(std::string_view s, FileVocabulary &v, Emit &e)
+        : src(s), vocab(v), emit(e), nodes(v.get_allocator()), tokens(v.get_allocator()), text(v.get_allocator())
+    {
+    }
 
-/// Mapping between options and traversal callables
-static std::unordered_map<std::string, std::function<std::vector<std::vector<TSNode>>(const TSNode &)>>
-    traversalPolicy = {{"root_terminal", std::bind(&Traversal::root2terminal, std::placeholders::_1)},
-                       {"terminal_terminal", std::bind(&Traversal::terminal2terminal, std::placeholders::_1)}};
+    void
+    enter(const TSNode &node)
+    {
+        nodes.push_back(node);
+        tokens.push_back(TokenizationPolicy::token(node, src, text));
+    }
 
-/// Mapping between options and tokenization callables
-static std::unordered_map<
-    std::string, std::function<std::optional<std::vector<TokenizedToken>>(
-                     const std::vector<TSNode> &, const std::string &, std::unordered_map<size_t, std::string> &)>>
-    tokenizationRules = {
-        {"masked_identifiers", std::bind(&Tokenizer::defaultTokenization, std::placeholders::_1, std::placeholders::_2,
-                                         std::placeholders::_3)},
+    void
+    leave()
+    {
+        nodes.pop_back();
+        tokens.pop_back();
+    }
+
+    void
+    pathFound()
+    {
+        if (!TokenizationPolicy::filter(nodes)) {
+            return;
+        }
+        // add a terminal to vocabulary
+        vocab[tokens.back().name] = text;
+        emit(std::span<const TokenizedToken>(tokens));
+    }
 };
 
-/// Mapping between options and split callables
-static std::unordered_map<std::string, std::function<std::string(const std::vector<TokenizedToken> &)>> splitStrategy =
+/// Class that keeps outputs of subtrees already seen in other files
+/// @brief - a subtree is identified by its Merkle hash: the hash of a node covers its symbol, its token and the
+/// hashes of its children in order, so equal hashes mean equal subtrees up to masked terminals (e.g. the same template
+/// header or fast-IO snippet with other names)
+/// @brief - entries are never changed or removed, the memo is thread-safe: it's split into shards with their own locks,
+/// lookups take a shared lock only
+/// @tparam Entry output of one subtree
+template <typename Entry> class SubtreeMemo
+{
+    /// Number of shards, a power of 2
+    static constexpr size_t numShards = 64;
+
+    /// One part of the memo
+    struct alignas(64) Shard {
+        std::shared_mutex m;
+        /// subtree's hash -> its output
+        std::unordered_map<uint64_t, Entry> entries;
+    };
+
+    std::array<Shard, numShards> shards;
+
+    /// Maximum size of all entries in bytes
+    size_t capacity;
+    /// Size of all entries in bytes
+    std::atomic_size_t size = 0;
+
+    /// @return the shard of a hash
+    Shard &
+    shard(uint64_t hash)
+    {
+        // hashes are uniform already, their top bits pick the shard
+        return shards[hash >> (64 - std::countr_zero(numShards))];
+    }
+
+  public:
+    /// @param c maximum size of all entries in bytes, 0 disables the memo
+    explicit SubtreeMemo(size_t c) : capacity(c) {}
+
+    SubtreeMemo(const SubtreeMemo &) = delete;
+
+    SubtreeMemo &operator=(const SubtreeMemo &) = delete;
+
+    /// @return whether subtrees are looked up at all
+    bool
+    enabled() const
+    {
+        return capacity > 0;
+    }
+
+    /// @return whether new entries are dropped
+    bool
+    full() const
+    {
+        return size.load(std::memory_order_relaxed) >= capacity;
+    }
+
+    /// @param hash Merkle hash of a subtree
+    /// @return output of the subtree or nullptr if it hasn't been seen, the entry is never invalidated
+    const Entry *
+    find(uint64_t hash)
+    {
+        auto &s = shard(hash);
+        std::shared_lock lk(s.m);
+        auto it = s.entries.find(hash);
+        return it == s.entries.end() ? nullptr : &it->second;
+    }
+
+    /// A function to remember the output of a subtree
+    /// @brief - the entry is dropped if the memo is full, an entry inserted first by another thread is kept
+    /// @param hash Merkle hash of the subtree
+    /// @param entry output of the subtree
+    /// @param bytes size of the entry
+    void
+    insert(uint64_t hash, Entry &&entry, size_t bytes)
     {
-        {"ids_hash", std::bind(&Split::toBranch, std::placeholders::_1)},
+        if (size.fetch_add(bytes, std::memory_order_relaxed) + bytes > capacity) {
+            size.fetch_sub(bytes, std::memory_order_relaxed);
+            return;
+        }
+        auto &s = shard(hash);
+        std::unique_lock lk(s.m);
+        if (!s.entries.try_emplace(hash, std::move(entry)).second) {
+            size.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+    }
 };
 
-/// Class that creates a TSTree from a given file and parses the input options to obtain the requested nodes'
-/// representation
-class Tree
+/// Limits of terminal-terminal paths
+/// @brief - the length of a path is the number of its edges: up from the first terminal to the lowest common
+/// ancestor (LCA) and down to the second terminal
+/// @brief - the width of a path is the distance between the two children of the LCA the path goes through
+struct TraversalLimits {
+    /// maximum length of a path
+    size_t maxLength = 8;
+    /// maximum width of a path
+    size_t maxWidth = 2;
+};
+
+/// Index of a tree that streams terminal-terminal paths
+/// @brief - every node is tokenized once, when the index is built, paths are assembled from the stored tokens
+/// @brief - every node keeps the terminals of its subtree that are close enough to be on a path of maxLength, and only
+/// children within maxWidth are paired, so paths exceeding the limits are never enumerated
+/// @brief - paths are grouped by their LCA, nodes are split into parts of nodesPerPart nodes, every part can be
+/// streamed on its own (e.g. by different workers), all parts in order give the same paths as the whole tree
+/// @brief - the index is allocated from a given memory resource
+/// @brief - every node keeps the Merkle hash of its subtree, a FragmentConsumer may splice the paths of a mid-sized
+/// subtree in from its memo instead of getting them one by one, the subtree is skipped then
+template <typename TokenizationPolicy> class LeafPairs
 {
-    /// A callable for tree traversal
-    std::function<std::vector<std::vector<TSNode>>(const TSNode &)> &traversal;
-    /// A callable for nodes' tokenization
-    std::function<std::optional<std::vector<TokenizedToken>>(const std::vector<TSNode> &, const std::string &,
-                                                             std::unordered_map<size_t, std::string> &)> &tokenizer;
-    /// A callable to split sequences of nodes
-    std::function<std::string(const std::vector<TokenizedToken> &)> &split;
+    static constexpr uint32_t none = UINT32_MAX;
+
+    /// Node of the tree, nodes are stored in preorder
+    struct Node {
+        uint32_t parent;
+        uint32_t firstChild = none;
+        uint32_t nextSibling = none;
+        /// position among the parent's children
+        uint32_t childIndex = 0;
+        /// index in texts, none for non-terminals and filtered terminals
+        uint32_t terminal = none;
+        TokenizedToken token;
+    };
+
+    /// Terminal reachable from a node
+    struct Reach {
+        /// the terminal
+        uint32_t node;
+        /// number of edges between the node and the terminal
+        uint32_t distance;
+    };
+
+    /// Subtree of a node
+    struct Fragment {
+        /// Merkle hash
+        uint64_t hash;
+        /// number of nodes, the subtree is [node, node + size) in preorder
+        uint32_t size;
+    };
+
+    /// Subtrees smaller than this aren't worth a lookup
+    static constexpr uint32_t minFragment = 16;
+    /// Subtrees larger than this rarely repeat, they aren't memoized
+    static constexpr uint32_t maxFragment = 1 << 12;
+
+    /// Visitor that builds the index during a single walk of the tree
+    class Builder
+    {
+        LeafPairs &index;
+        std::string_view src;
 
-    /// TreeSitter parser
-    TSParser *parser;
+        /// Nodes of the current path
+        std::pmr::vector<uint32_t> path;
+        /// The last entered child of every node of the current path
+        std::pmr::vector<uint32_t> lastChild;
+        /// The last entered node
+        TSNode last;
+        /// Vocabulary entry of the last entered terminal
+        std::pmr::string text;
+
+      public:
+        Builder(LeafPairs &i, std::string_view s)
+            : index(i), src(s), path(i.resource), lastChild(i.resource), text(i.resource)
+        {
+        }
+
+        void
+        enter(const TSNode &node)
+        {
+            uint32_t idx = index.nodes.size();
+            Node n{path.empty() ? none : path.back()};
+            if (!path.empty()) {
+                auto &prev = lastChild.back();
+                if (prev == none) {
+                    index.nodes[path.back()].firstChild = idx;
+                } else {
+                    index.nodes[prev].nextSibling = idx;
+                    n.childIndex = index.nodes[prev].childIndex + 1;
+                }
+                prev = idx;
+            }
+            n.token = TokenizationPolicy::token(node, src, text);
+            index.nodes.push_back(std::move(n));
+            path.push_back(idx);
+            lastChild.push_back(none);
+            last = node;
+        }
+
+        void
+        leave()
+        {
+            path.pop_back();
+            lastChild.pop_back();
+        }
+
+        void
+        pathFound()
+        {
+            if (!TokenizationPolicy::terminal(last)) {
+                return;
+            }
+            index.nodes[path.back()].terminal = index.texts.size();
+            index.texts.push_back(std::move(text));
+        }
+    };
+
+    /// Memory of the index
+    std::pmr::memory_resource *resource;
+    /// Nodes in preorder
+    std::pmr::vector<Node> nodes;
+    /// Vocabulary entries of terminals
+    std::pmr::vector<std::pmr::string> texts;
+    /// reach[reachBegin[i], reachBegin[i + 1]) are the terminals reachable from the i'th node
+    std::pmr::vector<uint32_t> reachBegin;
+    /// Reachable terminals of all nodes
+    std::pmr::vector<Reach> reach;
+    /// Limits of paths
+    TraversalLimits limits;
+    /// Subtrees of all nodes
+    std::pmr::vector<Fragment> fragments;
+
+    /// A function to compute the subtree of every node bottom-up
+    /// @brief - the hash of a node covers its symbol, token, whether it's a kept terminal and its children's hashes,
+    /// e.g. everything the paths inside the subtree are made of
+    void
+    hashFragments()
+    {
+        // the same subtree has other paths with other limits or tokenization, so it gets another hash
+        uint64_t params[] = {limits.maxLength, limits.maxWidth};
+        uint64_t seed = hashing::xxh64({reinterpret_cast<const char *>(params), sizeof(params)},
+                                       hashing::xxh64(TokenizationPolicy::option));
+        fragments.resize(nodes.size());
+        std::pmr::vector<uint64_t> words(resource);
+        for (uint32_t i = nodes.size(); i-- > 0;) {
+            const auto &n = nodes[i];
+            words.assign({n.token.symbol | (n.terminal == none ? 0ull : 1ull << 16), n.token.name});
+            uint32_t size = 1;
+            for (uint32_t c = n.firstChild; c != none; c = nodes[c].nextSibling) {
+                words.push_back(fragments[c].hash);
+                size += fragments[c].size;
+            }
+            auto bytes =
+                std::string_view(reinterpret_cast<const char *>(words.data()), words.size() * sizeof(uint64_t));
+            fragments[i] = {hashing::xxh64(bytes, seed), size};
+        }
+    }
+
+    /// A function to pass every (ancestor, terminal, distance) triple within the limits to a callable
+    /// @brief - a terminal is at most maxLength - 1 edges away, the other half of a path takes at least one edge
+    template <typename F>
+    void
+    forEachReach(F &&f) const
+    {
+        for (uint32_t i = 0; i < nodes.size(); ++i) {
+            if (nodes[i].terminal == none) {
+                continue;
+            }
+            uint32_t distance = 0;
+            for (uint32_t u = i; u != none && distance < limits.maxLength; u = nodes[u].parent, ++distance) {
+                f(u, i, distance);
+            }
+        }
+    }
+
+    /// @return terminals reachable from a node
+    std::span<const Reach>
+    reachable(uint32_t node) const
+    {
+        return {reach.data() + reachBegin[node], reach.data() + reachBegin[node + 1]};
+    }
+
+    /// A function to assemble a path: up from a terminal to the LCA and down to another terminal
+    /// @brief - the turn marker goes right before the LCA, see turnSymbol
+    /// @param path the resulting path
+    /// @param from the first terminal
+    /// @param left the LCA's child on the way up
+    /// @param lca the LCA
+    /// @param right the LCA's child on the way down
+    /// @param to the second terminal
+    void
+    assemble(std::pmr::vector<TokenizedToken> &path, uint32_t from, uint32_t left, uint32_t lca, uint32_t right,
+             uint32_t to) const
+    {
+        path.clear();
+        for (uint32_t u = from;; u = nodes[u].parent) {
+            path.push_back(nodes[u].token);
+            if (u == left) {
+                break;
+            }
+        }
+        path.push_back({0, turnSymbol});
+        path.push_back(nodes[lca].token);
+        auto down = path.size();
+        for (uint32_t u = to;; u = nodes[u].parent) {
+            path.push_back(nodes[u].token);
+            if (u == right) {
+                break;
+            }
+        }
+        std::reverse(path.begin() + down, path.end());
+    }
+
+    /// A function to assemble every path whose LCA is a given node
+    /// @param lca the LCA
+    /// @param path buffer of the paths
+    /// @param f a callable getting the first and the second terminal of each assembled path
+    template <typename F>
+    void
+    pairs(uint32_t lca, std::pmr::vector<TokenizedToken> &path, F &&f) const
+    {
+        for (uint32_t left = nodes[lca].firstChild; left != none; left = nodes[left].nextSibling) {
+            for (uint32_t right = nodes[left].nextSibling;
+                 right != none && nodes[right].childIndex - nodes[left].childIndex <= limits.maxWidth;
+                 right = nodes[right].nextSibling) {
+                for (const auto &from : reachable(left)) {
+                    // from - left - lca - right takes 2 edges more
+                    if (from.distance + 2 > limits.maxLength) {
+                        continue;
+                    }
+                    for (const auto &to : reachable(right)) {
+                        if (from.distance + to.distance + 2 > limits.maxLength) {
+                            continue;
+                        }
+                        assemble(path, from.node, left, lca, right, to.node);
+                        f(from.node, to.node);
+                    }
+                }
+            }
+        }
+    }
+
+    /// A function that streams the paths whose LCA is in [begin, end) subtree by subtree
+    /// @brief - recordings are nested, a subtree inside a recorded one is looked up and recorded as well
+    /// @brief - a subtree keeps its paths in the order they are streamed, so the output doesn't depend on whether it
+    /// was spliced in or enumerated
+    template <typename Emit>
+    void
+    visitFragments(uint32_t begin, uint32_t end, FileVocabulary &vocab, Emit &emit) const
+    {
+        auto alloc = vocab.get_allocator();
+        std::pmr::vector<TokenizedToken> path(alloc);
+        // subtrees being recorded: the first node after the subtree and the first of its terminals in used
+        std::pmr::vector<std::pair<uint32_t, size_t>> recordings(alloc);
+        // terminals of the recorded paths
+        std::pmr::vector<uint32_t> used(alloc);
+        std::pmr::vector<uint8_t> seen(alloc);
+        std::pmr::vector<std::pair<size_t, std::string_view>> terminals(alloc);
+
+        auto close = [&]() {
+            terminals.clear();
+            for (size_t i = recordings.back().second; i < used.size(); ++i) {
+                if (!std::exchange(seen[used[i] - begin], 1)) {
+                    terminals.emplace_back(nodes[used[i]].token.name, texts[nodes[used[i]].terminal]);
+                }
+            }
+            for (size_t i = recordings.back().second; i < used.size(); ++i) {
+                seen[used[i] - begin] = 0;
+            }
+            emit.close(std::span<const std::pair<size_t, std::string_view>>(terminals));
+            recordings.pop_back();
+            if (recordings.empty()) {
+                used.clear();
+            }
+        };
+
+        for (uint32_t lca = begin; lca < end;) {
+            while (!recordings.empty() && recordings.back().first <= lca) {
+                close();
+            }
+            const auto &fragment = fragments[lca];
+            if (fragment.size >= minFragment && fragment.size <= maxFragment && lca + fragment.size <= end) {
+                if (emit.splice(fragment.hash, vocab)) {
+                    lca += fragment.size;
+                    continue;
+                }
+                if (emit.open(fragment.hash)) {
+                    if (seen.empty()) {
+                        seen.assign(end - begin, 0);
+                    }
+                    recordings.emplace_back(lca + fragment.size, used.size());
+                }
+            }
+            pairs(lca, path, [&](uint32_t from, uint32_t to) {
+                vocab[path.front().name] = texts[nodes[from].terminal];
+                vocab[path.back().name] = texts[nodes[to].terminal];
+                emit(std::span<const TokenizedToken>(path));
+                if (!recordings.empty()) {
+                    used.push_back(from);
+                    used.push_back(to);
+                }
+            });
+            ++lca;
+        }
+        while (!recordings.empty()) {
+            close();
+        }
+    }
+
+  public:
+    /// Number of nodes in a part
+    static constexpr size_t nodesPerPart = 1 << 13;
+
+    /// Constructor to build the index
+    /// @param root the root of a tree
+    /// @param src file's context
+    /// @param l limits of paths
+    /// @param r memory of the index
+    LeafPairs(const TSNode &root, std::string_view src, const TraversalLimits &l, std::pmr::memory_resource *r)
+        : resource(r), nodes(r), texts(r), reachBegin(r), reach(r), limits(l), fragments(r)
+    {
+        Builder builder(*this, src);
+        Traversal::root2terminal(root, builder);
+
+        // counting sort of reachable terminals by their ancestors, terminals of a node stay in preorder
+        reachBegin.assign(nodes.size() + 1, 0);
+        forEachReach([&](uint32_t u, uint32_t, uint32_t) { ++reachBegin[u + 1]; });
+        std::partial_sum(reachBegin.begin(), reachBegin.end(), reachBegin.begin());
+        reach.resize(reachBegin.back());
+        std::pmr::vector<uint32_t> next(reachBegin.begin(), reachBegin.end() - 1, resource);
+        forEachReach([&](uint32_t u, uint32_t t, uint32_t distance) { reach[next[u]++] = {t, distance}; });
+        hashFragments();
+    }
+
+    /// @return number of parts
+    size_t
+    parts() const
+    {
+        return std::max<size_t>(1, (nodes.size() + nodesPerPart - 1) / nodesPerPart);
+    }
+
+    /// A function that streams the paths whose LCA is in a part, it may be called concurrently for different parts
+    /// @param part index of the part
+    /// @param vocab vocabulary the terminals of the paths are added to
+    /// @param emit a callable getting each path, the vector is only valid during the call, it may be a
+    /// FragmentConsumer
+    template <typename Emit>
+    void
+    visit(size_t part, FileVocabulary &vocab, Emit &emit) const
+    {
+        uint32_t begin = part * nodesPerPart;
+        uint32_t end = std::min(nodes.size(), (part + 1) * nodesPerPart);
+        if constexpr (FragmentConsumer<Emit>) {
+            visitFragments(begin, end, vocab, emit);
+        } else {
+            std::pmr::vector<TokenizedToken> path(vocab.get_allocator());
+            for (uint32_t lca = begin; lca < end; ++lca) {
+                pairs(lca, path, [&](uint32_t from, uint32_t to) {
+                    vocab[path.front().name] = texts[nodes[from].terminal];
+                    vocab[path.back().name] = texts[nodes[to].terminal];
+                    emit(std::span<const TokenizedToken>(path));
+                });
+            }
+        }
+    }
+};
+
+/*#########################################################################################################//
+Extraction policies
+
+Every option of the extractor is a policy type with its option name, a pipeline is a combination of one
+traversal, one tokenization and one split policy fixed at compile time, so the inner loop is inlined.
+To add an option, define a policy and add it to the corresponding list below.
+//#########################################################################################################*/
+
+/// Traversal policy "root_terminal"
+struct RootTerminal {
+    static constexpr std::string_view option = "root_terminal";
+    /// Paths start at the root and end at a terminal
+    static constexpr bool twoTerminals = false;
+
+    /// Paths of one tree, the tree is streamed as a whole, limits don't apply
+    template <typename Tokenization> class State
+    {
+        TSNode root;
+        std::string_view src;
+
+      public:
+        State(const TSNode &r, std::string_view s, const TraversalLimits &, std::pmr::memory_resource *)
+            : root(r), src(s)
+        {
+        }
+
+        size_t
+        parts() const
+        {
+            return 1;
+        }
+
+        template <typename Emit>
+        void
+        visit(size_t, FileVocabulary &vocab, Emit &emit) const
+        {
+            TokenizingVisitor<Tokenization, Emit> visitor(src, vocab, emit);
+            Traversal::root2terminal(root, visitor);
+        }
+    };
+};
+
+/// Traversal policy "terminal_terminal"
+struct TerminalTerminal {
+    static constexpr std::string_view option = "terminal_terminal";
+    /// Paths start and end at terminals
+    static constexpr bool twoTerminals = true;
+
+    /// Paths of one tree, see LeafPairs
+    template <typename Tokenization> using State = LeafPairs<Tokenization>;
+};
+
+/// Tokenization policy "masked_identifiers"
+struct MaskedIdentifiers {
+    static constexpr std::string_view option = "masked_identifiers";
+
+    static TokenizedToken
+    token(const TSNode &node, std::string_view src, std::pmr::string &text)
+    {
+        return Tokenizer::defaultToken(node, src, text);
+    }
+
+    static bool
+    filter(std::span<const TSNode> nodes)
+    {
+        return Tokenizer::defaultFilter(nodes);
+    }
+
+    static bool
+    terminal(const TSNode &node)
+    {
+        return Tokenizer::defaultTerminal(node);
+    }
+};
+
+/// Split policy "ids_hash"
+struct IdsHash {
+    static constexpr std::string_view option = "ids_hash";
+    /// Only the last terminal is written
+    static constexpr bool twoTerminals = false;
+
+    static void
+    split(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext, std::string &out)
+    {
+        Split::toBranch(symbols, pathContext, out);
+    }
+};
+
+/// Split policy "hash_ids_hash"
+struct HashIdsHash {
+    static constexpr std::string_view option = "hash_ids_hash";
+    /// Both terminals are written
+    static constexpr bool twoTerminals = true;
+
+    static void
+    split(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext, std::string &out)
+    {
+        Split::toContext(symbols, pathContext, out);
+    }
+};
+
+/// Available traversal policies
+using TraversalPolicies = std::tuple<RootTerminal, TerminalTerminal>;
+/// Available tokenization policies
+using TokenizationPolicies = std::tuple<MaskedIdentifiers>;
+/// Available split policies
+using SplitPolicies = std::tuple<IdsHash, HashIdsHash>;
+
+/// Combination of policies
+template <typename TraversalPolicy, typename TokenizationPolicy, typename SplitPolicy> struct Pipeline {
+    using Traversal = TraversalPolicy;
+    using Tokenization = TokenizationPolicy;
+    using Split = SplitPolicy;
+};
+
+/// A function to find a policy by its option and pass it to a callable
+/// @param option option of a policy
+/// @param f a callable getting std::type_identity<policy>
+/// @return whether the policy was found
+template <typename Policies, typename F>
+bool
+findPolicy(std::string_view option, F &&f)
+{
+    return std::apply(
+        [&]<typename... Ps>(Ps...) {
+            return ((Ps::option == option ? (f(std::type_identity<Ps>{}), true) : false) || ...);
+        },
+        Policies{});
+}
+
+/// A function to map string options to a pipeline, should be called once at startup
+/// @param traversal traversal option
+/// @param token tokenization option
+/// @param split split option
+/// @param f a callable getting std::type_identity<Pipeline<...>>, the rest of the run is specialized for it
+/// @brief - the split must write as many terminals as the traversal's paths have, e.g. a split that writes one
+/// terminal is rejected for paths between two terminals and vice versa
+template <typename F>
+void
+withPipeline(std::string_view traversal, std::string_view token, std::string_view split, F &&f)
+{
+    bool found = false;
+    findPolicy<TraversalPolicies>(traversal, [&]<typename T>(std::type_identity<T>) {
+        findPolicy<TokenizationPolicies>(token, [&]<typename K>(std::type_identity<K>) {
+            found = findPolicy<SplitPolicies>(split, [&]<typename S>(std::type_identity<S>) {
+                if constexpr (T::twoTerminals && !S::twoTerminals) {
+                    throw std::format("Split {} drops the first terminal of {} paths!", S::option, T::option);
+                } else if constexpr (!T::twoTerminals && S::twoTerminals) {
+                    throw std::format("Split {} needs two terminals, {} paths have one!", S::option, T::option);
+                } else {
+                    f(std::type_identity<Pipeline<T, K, S>>{});
+                }
+            });
+        });
+    });
+    if (!found) {
+        throw std::format("Unknown options {}|{}|{}", traversal, token, split);
+    }
+}
+
+/// Class that caches TreeSitter parsers
+/// @brief - every thread keeps a pool of parsers, one per language, a parser is created on the first use and deleted
+/// when the thread exits, so files don't pay for the parser's construction and its internal allocations
+/// @brief - a parser is only borrowed for one parse and reset right after it, no state is kept between files
+class ParserCache
+{
+  public:
+    /// A function to parse a source with a parser of the calling thread
+    /// @param lang language of the source
+    /// @param src source
+    /// @param length length of the source in bytes
+    /// @return a new tree, owned by the caller
+    static TSTree *parse(const TSLanguage *lang, const char *src, uint32_t length);
+};
+
+/// Class that creates a TSTree from a given file
+/// @brief - the pipeline-independent part of Tree
+class ParsedTree
+{
+  protected:
     /// TreeSitter tree
     TSTree *tree;
     /// File's context
-    std::string src;
+    SourceBuffer src;
     /// The root of a tree
     TSNode root;
+    /// Grammar of the tree
+    const TSLanguage *grammar;
+
+  public:
+    /// Constructor to build a TSTree
+    /// @param fileName path to input file
+    /// @param lang fileName's language
+    ParsedTree(const std::string &fileName, const Language &lang);
+
+    /// Constructor to build a TSTree from an already loaded file
+    /// @param source content of the file, the tree takes it over
+    /// @param lang source's language
+    ParsedTree(SourceBuffer &&source, const Language &lang);
+
+    ParsedTree(const ParsedTree &) = delete;
+
+    ParsedTree &operator=(const ParsedTree &) = delete;
+
+    ~ParsedTree();
+};
+
+/// Class that creates a TSTree from a given file and processes it with a pipeline of policies
+/// @brief - scratch memory of the traversal (stacks, indices, the vocabulary) is taken from a given memory resource,
+/// e.g. a ScratchArena released once the file is done
+template <typename Pipeline> class Tree : public ParsedTree
+{
+    using State = typename Pipeline::Traversal::template State<typename Pipeline::Tokenization>;
+
+    /// Traversal's view of the tree
+    State state;
 
   public:
     /// A vocabulary storing mapping between hashes and the corresponding terminals' names
-    std::unordered_map<size_t, std::string> vocab;
+    FileVocabulary vocab;
 
-    /// Constructor to build a TSTree and set the requested callables
+    /// Constructor to build a tree
     /// @param fileName path to input file
     /// @param lang fileName's language
-    /// @param traversalParam traversal option (the way we traverse tree and collect nodes)
-    /// @param tokenizationParam tokenization option (the way we encode nodes)
-    /// @param splitParam split option (the way we construct a path-context from sequence of nodes)
-    Tree(const std::string &fileName, const std::string &lang, const std::string &traversalParam,
-         const std::string &tokenizationParam, const std::string &splitParam);
+    /// @param limits limits of paths
+    /// @param resource scratch memory
+    Tree(const std::string &fileName, const Language &lang, const TraversalLimits &limits = {},
+         std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : ParsedTree(fileName, lang), state(root, src.view(), limits, resource), vocab(resource)
+    {
+    }
 
-    /// A function that applies the chosen callables to process an inner file in the right way
-    /// @return a vector of strings representing one line in the resulting file
-    std::vector<std::string> process();
+    /// Constructor to build a tree from an already loaded file
+    /// @param source content of the file, the tree takes it over
+    /// @param lang source's language
+    /// @param limits limits of paths
+    /// @param resource scratch memory
+    Tree(SourceBuffer &&source, const Language &lang, const TraversalLimits &limits = {},
+         std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : ParsedTree(std::move(source), lang), state(root, src.view(), limits, resource), vocab(resource)
+    {
+    }
 
-    ~Tree();
+    /// @return number of parts the paths can be streamed in independently
+    size_t
+    parts() const
+    {
+        return state.parts();
+    }
+
+    /// A function that streams the path-contexts of one part, it may be called concurrently for different parts
+    /// @param part index of the part
+    /// @param partVocab vocabulary of the part
+    /// @param emit a callable getting each path-context, the span is only valid during the call
+    template <typename Emit>
+    void
+    visitPart(size_t part, FileVocabulary &partVocab, Emit &emit) const
+    {
+        state.visit(part, partVocab, emit);
+    }
+
+    /// A function that streams "correct" tokenized path-contexts one by one, nothing is materialized
+    /// @param emit a callable getting each path-context, the span is only valid during the call
+    template <typename Emit>
+    void
+    visit(Emit &&emit)
+    {
+        for (size_t i = 0; i < state.parts(); ++i) {
+            state.visit(i, vocab, emit);
+        }
+    }
+
+    /// A function that applies the traversal and tokenization policies, but leaves path-contexts unsplit
+    /// @return a vector of "correct" tokenized path-contexts
+    std::vector<std::vector<TokenizedToken>>
+    tokenize()
+    {
+        std::vector<std::vector<TokenizedToken>> tokens;
+        profiler::ScopedTimer timer(profiler::Stage::Traversal);
+        visit([&tokens](std::span<const TokenizedToken> path) { tokens.emplace_back(path.begin(), path.end()); });
+        return tokens;
+    }
+
+    /// A function that applies the whole pipeline to process an inner file in the right way
+    /// @return a vector of strings representing one line in the resulting file
+    std::vector<std::string>
+    process()
+    {
+        std::vector<std::string> res;
+        const auto &symbols = SymbolEncoding::of(grammar);
+        profiler::ScopedTimer timer(profiler::Stage::Traversal);
+        visit([&](std::span<const TokenizedToken> path) {
+            // get path-context's final representation
+            Pipeline::Split::split(symbols, path, res.emplace_back());
+        });
+        return res;
+    }
 };
 
 class TreeSitter
 {
 
-    TSParser *parser;
     TSTree *tree;
-    std::string src;
+    std::shared_ptr<SourceBuffer> src;
     int option;
 
   public:
@@ -238,7 +1158,7 @@ class TreeSitter
     // get AST
     void getGraph(const char *file);
 
-    std::string getContext() const;
+    std::string_view getContext() const;
 
     // free memory here
     ~TreeSitter();
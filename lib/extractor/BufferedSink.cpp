@@ -0,0 +1,67 @@
+#include <extractor/BufferedSink.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+extractor::BufferedSink::BufferedSink(const std::filesystem::path &file, size_t cap) : capacity(cap)
+{
+    fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::format("Unable to open {}: {}", file.string(), strerror(errno));
+    }
+    buffer.reserve(capacity);
+}
+
+void
+extractor::BufferedSink::write(std::string_view data)
+{
+    buffer.append(data);
+    if (buffer.size() >= capacity) {
+        flush();
+    }
+}
+
+void
+extractor::BufferedSink::flush()
+{
+    size_t written = 0;
+    while (written < buffer.size()) {
+        auto n = ::write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::format("Unable to write output: {}", strerror(errno));
+        }
+        written += n;
+    }
+    buffer.clear();
+}
+
+void
+extractor::BufferedSink::overwrite(uint64_t pos, std::string_view data)
+{
+    flush();
+    size_t written = 0;
+    while (written < data.size()) {
+        auto n = ::pwrite(fd, data.data() + written, data.size() - written, pos + written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::format("Unable to write output: {}", strerror(errno));
+        }
+        written += n;
+    }
+}
+
+extractor::BufferedSink::~BufferedSink()
+{
+    try {
+        flush();
+    } catch (...) {
+    }
+    close(fd);
+}
@@ -0,0 +1,191 @@
+#include <extractor/Cache.h>
+#include <support/Profiler/Profiler.h>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+/// Signature and version of a cache entry
+constexpr char cacheMagic[8] = {'E', 'D', 'C', 'A', 'C', 'H', 'E', '3'};
+
+/// A function to append a trivially copyable value to a buffer
+template <typename T>
+void
+put(std::string &buf, const T &value)
+{
+    buf.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/// A function to append a string prefixed with its length
+void
+putString(std::string &buf, std::string_view str)
+{
+    put(buf, static_cast<uint32_t>(str.size()));
+    buf.append(str);
+}
+
+/// Encoded size of a token
+constexpr size_t tokenSize = sizeof(treesitter::TokenizedToken::name) + sizeof(treesitter::TokenizedToken::symbol);
+
+/// Cursor over a serialized entry, every read checks the bounds
+struct Reader {
+    std::string_view data;
+
+    /// @param count number of items read from the data
+    /// @param itemSize minimum encoded size of an item
+    /// @return whether the data is large enough for the items, so sizes read from disk are checked before allocating
+    bool
+    has(size_t count, size_t itemSize) const
+    {
+        return count <= data.size() / itemSize;
+    }
+
+    template <typename T>
+    bool
+    get(T &value)
+    {
+        if (data.size() < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    bool
+    getString(std::string &str)
+    {
+        uint32_t len;
+        if (!get(len) || data.size() < len) {
+            return false;
+        }
+        str.assign(data.substr(0, len));
+        data.remove_prefix(len);
+        return true;
+    }
+};
+
+/// A function to deserialize an entry
+/// @param buf content of an entry's file
+/// @param size expected size of the source file
+/// @return the entry or std::nullopt if it's corrupted or belongs to another file
+std::optional<extractor::CacheEntry>
+decode(std::string_view buf, size_t size)
+{
+    Reader r{buf};
+
+    char magic[8];
+    uint64_t storedSize;
+    uint32_t numContexts;
+    if (!r.get(magic) || std::memcmp(magic, cacheMagic, sizeof(magic)) != 0 || !r.get(storedSize) ||
+        storedSize != size || !r.get(numContexts) || !r.has(numContexts, sizeof(uint32_t))) {
+        return std::nullopt;
+    }
+
+    extractor::CacheEntry entry;
+    entry.tokens.resize(numContexts);
+    for (auto &path : entry.tokens) {
+        uint32_t len;
+        if (!r.get(len) || !r.has(len, tokenSize)) {
+            return std::nullopt;
+        }
+        path.resize(len);
+        for (auto &token : path) {
+            if (!r.get(token.name) || !r.get(token.symbol)) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    uint32_t numVocab;
+    if (!r.get(numVocab)) {
+        return std::nullopt;
+    }
+    for (uint32_t i = 0; i < numVocab; ++i) {
+        size_t hash;
+        std::string name;
+        if (!r.get(hash) || !r.getString(name)) {
+            return std::nullopt;
+        }
+        entry.vocab.emplace(hash, std::move(name));
+    }
+    return entry;
+}
+} // namespace
+
+extractor::Cache::Cache(const std::filesystem::path &root, std::string_view options)
+    : dir(root / std::format("{:016x}", key(options)))
+{
+    std::filesystem::create_directories(dir);
+}
+
+uint64_t
+extractor::Cache::key(std::string_view content, std::string_view language)
+{
+    // the same content parsed with another grammar is another entry
+    return hashing::xxh64(content, hashing::xxh64(language));
+}
+
+std::filesystem::path
+extractor::Cache::entryPath(uint64_t key) const
+{
+    auto name = std::format("{:016x}", key);
+    return dir / name.substr(0, 2) / name;
+}
+
+std::optional<extractor::CacheEntry>
+extractor::Cache::load(uint64_t key, size_t size)
+{
+    std::optional<CacheEntry> entry;
+    std::ifstream file(entryPath(key), std::ios::binary);
+    if (file) {
+        std::stringstream ss;
+        ss << file.rdbuf();
+        entry = decode(ss.str(), size);
+    }
+
+    profiler::count(entry.has_value() ? profiler::Counter::CacheHits : profiler::Counter::CacheMisses);
+    return entry;
+}
+
+void
+extractor::Cache::store(uint64_t key, size_t size, const CacheEntry &entry)
+{
+    std::string buf;
+    buf.append(cacheMagic, sizeof(cacheMagic));
+    put(buf, static_cast<uint64_t>(size));
+    put(buf, static_cast<uint32_t>(entry.tokens.size()));
+    for (const auto &path : entry.tokens) {
+        put(buf, static_cast<uint32_t>(path.size()));
+        for (const auto &token : path) {
+            put(buf, token.name);
+            put(buf, token.symbol);
+        }
+    }
+    put(buf, static_cast<uint32_t>(entry.vocab.size()));
+    for (const auto &[hash, name] : entry.vocab) {
+        put(buf, hash);
+        putString(buf, name);
+    }
+
+    auto path = entryPath(key);
+    std::filesystem::create_directories(path.parent_path());
+
+    // write a private file and publish it atomically
+    std::stringstream tid;
+    tid << std::this_thread::get_id();
+    auto temp = path;
+    temp += std::format(".{}.{}.tmp", getpid(), tid.str());
+    {
+        std::ofstream file(temp, std::ios::binary);
+        file.write(buf.data(), buf.size());
+        if (!file) {
+            throw std::format("Unable to write cache entry {}", temp.string());
+        }
+    }
+    std::filesystem::rename(temp, path);
+}
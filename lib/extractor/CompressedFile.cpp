@@ -0,0 +1,242 @@
+#include <extractor/CompressedFile.h>
+#include <extractor/Bounds.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+namespace
+{
+/// A function to view a trivially copyable object as bytes
+template <typename T>
+std::string_view
+asBytes(const T &obj)
+{
+    return {reinterpret_cast<const char *>(&obj), sizeof(T)};
+}
+
+/// A function to check that every block of a mapped file lies within it
+/// @param data the file, its header is valid
+/// @param size size of the file
+/// @return the first problem found, empty if there's none
+std::string
+validate(const std::byte *data, size_t size)
+{
+    const auto &header = *reinterpret_cast<const extractor::BlockFileHeader *>(data);
+    if (!extractor::fits(header.indexOffset, header.numBlocks, sizeof(extractor::BlockIndexEntry), size)) {
+        return "the index is out of bounds";
+    }
+
+    auto index = reinterpret_cast<const extractor::BlockIndexEntry *>(data + header.indexOffset);
+    // blocks follow each other in the content, so their raw sizes can't add up to more than the whole content
+    uint64_t rawOffset = 0;
+    for (uint64_t i = 0; i < header.numBlocks; ++i) {
+        const auto &e = index[i];
+        if (!extractor::fits(e.offset, e.size, 1, header.indexOffset)) {
+            return std::format("block {} is out of bounds", i);
+        }
+        if (e.rawSize > header.blockSize || e.rawOffset != rawOffset || e.rawSize > header.rawSize - rawOffset) {
+            return std::format("raw size of block {} is out of bounds", i);
+        }
+        rawOffset += e.rawSize;
+    }
+    if (rawOffset != header.rawSize) {
+        return "blocks don't add up to the content";
+    }
+    return {};
+}
+} // namespace
+
+extractor::CompressedFileWriter::CompressedFileWriter(const std::filesystem::path &file,
+                                                      threadpool::ThreadPool &workers, size_t size, int compression)
+    : out(file), pool(workers), maxPending(2 * workers.numThreads()), blockSize(size), level(compression)
+{
+    // the header keeps the block size in 32 bits
+    if (blockSize == 0 || blockSize > UINT32_MAX) {
+        throw std::format("Block size {} is out of range!", blockSize);
+    }
+    // reserve space for the header, it's filled in by close()
+    out.write(asBytes(BlockFileHeader{}));
+    offset = sizeof(BlockFileHeader);
+    buffer.reserve(blockSize);
+}
+
+void
+extractor::CompressedFileWriter::write(std::string_view data)
+{
+    if (buffer.size() + data.size() > blockSize) {
+        seal();
+    }
+    // only data larger than a block is split
+    while (data.size() > blockSize) {
+        buffer.assign(data.substr(0, blockSize));
+        seal();
+        data.remove_prefix(blockSize);
+    }
+    buffer += data;
+    if (buffer.size() == blockSize) {
+        seal();
+    }
+}
+
+void
+extractor::CompressedFileWriter::seal()
+{
+    if (buffer.empty()) {
+        return;
+    }
+
+    // the raw data is moved into the task and freed with it, only the compressed block comes back
+    pending.push_back(pool.addTask(
+        [](const std::string &raw, int lvl) {
+            Block block{std::string(compressBound(raw.size()), '\0'), raw.size()};
+            uLongf len = block.compressed.size();
+            int status = compress2(reinterpret_cast<Bytef *>(block.compressed.data()), &len,
+                                   reinterpret_cast<const Bytef *>(raw.data()), raw.size(), lvl);
+            if (status != Z_OK) {
+                throw std::format("Unable to compress a block: zlib error {}", status);
+            }
+            block.compressed.resize(len);
+            return block;
+        },
+        std::move(buffer), level));
+
+    buffer = std::string();
+    buffer.reserve(blockSize);
+    while (pending.size() > maxPending) {
+        drain();
+    }
+}
+
+void
+extractor::CompressedFileWriter::drain()
+{
+    auto done = std::move(pending.front());
+    pending.pop_front();
+    // a zlib error is rethrown here
+    auto block = done.get();
+
+    index.push_back({offset, block.compressed.size(), rawOffset, block.rawSize});
+    out.write(block.compressed);
+    offset += block.compressed.size();
+    rawOffset += block.rawSize;
+}
+
+void
+extractor::CompressedFileWriter::close()
+{
+    if (closed) {
+        return;
+    }
+    closed = true;
+
+    seal();
+    while (!pending.empty()) {
+        drain();
+    }
+
+    // the index is read in place, so it starts at an 8-byte boundary
+    static constexpr char zeros[8] = {};
+    auto padding = (8 - offset % 8) % 8;
+    out.write({zeros, padding});
+    offset += padding;
+
+    BlockFileHeader header{};
+    std::memcpy(header.magic, blockFileMagic, sizeof(header.magic));
+    header.version = blockFileVersion;
+    header.blockSize = blockSize;
+    header.numBlocks = index.size();
+    header.rawSize = rawOffset;
+    header.indexOffset = offset;
+    out.write({reinterpret_cast<const char *>(index.data()), index.size() * sizeof(BlockIndexEntry)});
+
+    out.overwrite(0, asBytes(header));
+}
+
+extractor::CompressedFileWriter::~CompressedFileWriter()
+{
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+extractor::CompressedFileReader::CompressedFileReader(const std::filesystem::path &file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::format("Unable to open {}: {}", file.string(), strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw std::format("Unable to stat {}: {}", file.string(), strerror(errno));
+    }
+    size = st.st_size;
+    if (size < sizeof(BlockFileHeader)) {
+        ::close(fd);
+        throw std::format("{} is not a block-compressed file!", file.string());
+    }
+
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::format("Unable to map {}: {}", file.string(), strerror(errno));
+    }
+    data = static_cast<const std::byte *>(addr);
+
+    header = reinterpret_cast<const BlockFileHeader *>(data);
+    if (std::memcmp(header->magic, blockFileMagic, sizeof(header->magic)) != 0 ||
+        header->version != blockFileVersion) {
+        munmap(addr, size);
+        throw std::format("{} is not a block-compressed file of version {}!", file.string(), blockFileVersion);
+    }
+    if (auto error = validate(data, size); !error.empty()) {
+        munmap(addr, size);
+        throw std::format("{} is corrupted: {}!", file.string(), error);
+    }
+
+    index = reinterpret_cast<const BlockIndexEntry *>(data + header->indexOffset);
+}
+
+size_t
+extractor::CompressedFileReader::blockCount() const
+{
+    return header->numBlocks;
+}
+
+uint64_t
+extractor::CompressedFileReader::rawSize() const
+{
+    return header->rawSize;
+}
+
+const extractor::BlockIndexEntry &
+extractor::CompressedFileReader::entry(size_t i) const
+{
+    return index[i];
+}
+
+std::string
+extractor::CompressedFileReader::block(size_t i) const
+{
+    // the entry is validated, so the allocation is at most a block
+    const auto &e = index[i];
+    std::string res(e.rawSize, '\0');
+    uLongf len = e.rawSize;
+    if (uncompress(reinterpret_cast<Bytef *>(res.data()), &len, reinterpret_cast<const Bytef *>(data + e.offset),
+                   e.size) != Z_OK ||
+        len != e.rawSize) {
+        throw std::format("Block {} is corrupted!", i);
+    }
+    return res;
+}
+
+extractor::CompressedFileReader::~CompressedFileReader()
+{
+    munmap(const_cast<std::byte *>(data), size);
+}
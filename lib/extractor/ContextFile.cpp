@@ -0,0 +1,223 @@
+#include <extractor/ContextFile.h>
+#include <extractor/Bounds.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <format>
+
+namespace
+{
+/// A function to view a trivially copyable object as bytes
+template <typename T>
+std::string_view
+asBytes(const T &obj)
+{
+    return {reinterpret_cast<const char *>(&obj), sizeof(T)};
+}
+
+/// A function to view a vector of trivially copyable objects as bytes
+template <typename T>
+std::string_view
+asBytes(const std::vector<T> &vec)
+{
+    return {reinterpret_cast<const char *>(vec.data()), vec.size() * sizeof(T)};
+}
+
+/// A function to check that every offset of a mapped file points into it
+/// @param data the file, its header is valid
+/// @param size size of the file
+/// @return the first problem found, empty if there's none
+std::string
+validate(const std::byte *data, size_t size)
+{
+    const auto &header = *reinterpret_cast<const extractor::ContextFileHeader *>(data);
+    if (!extractor::fits(header.indexOffset, header.numFiles, sizeof(extractor::FileIndexEntry), size)) {
+        return "the index is out of bounds";
+    }
+    // numPaths + 1 doesn't overflow once numPaths is less than the size
+    if (header.numPaths >= size ||
+        !extractor::fits(header.pathsOffset, header.numPaths + 1, sizeof(uint64_t), size)) {
+        return "the path table is out of bounds";
+    }
+
+    auto offsets = reinterpret_cast<const uint64_t *>(data + header.pathsOffset);
+    size_t bytesSize = size - header.pathsOffset - (header.numPaths + 1) * sizeof(uint64_t);
+    for (uint64_t id = 0; id < header.numPaths; ++id) {
+        if (offsets[id] > offsets[id + 1]) {
+            return std::format("path {} has a negative size", id);
+        }
+    }
+    if (offsets[header.numPaths] > bytesSize) {
+        return "the paths' bytes are out of bounds";
+    }
+
+    auto index = reinterpret_cast<const extractor::FileIndexEntry *>(data + header.indexOffset);
+    for (uint64_t i = 0; i < header.numFiles; ++i) {
+        if (!extractor::fits(index[i].offset, index[i].count, sizeof(extractor::ContextRecord), size)) {
+            return std::format("records of file {} are out of bounds", i);
+        }
+        if (!extractor::fits(index[i].nameOffset, index[i].nameSize, 1, size)) {
+            return std::format("name of file {} is out of bounds", i);
+        }
+    }
+    return {};
+}
+} // namespace
+
+extractor::ContextFileWriter::ContextFileWriter(const std::filesystem::path &file,
+                                                const treesitter::PathInterner &paths)
+    : out(file), interner(paths)
+{
+    // reserve space for the header, it's filled in by close()
+    append(asBytes(ContextFileHeader{}));
+}
+
+void
+extractor::ContextFileWriter::append(std::string_view data)
+{
+    out.write(data);
+    offset += data.size();
+}
+
+void
+extractor::ContextFileWriter::align()
+{
+    static constexpr char zeros[8] = {};
+    append({zeros, (8 - offset % 8) % 8});
+}
+
+void
+extractor::ContextFileWriter::write(std::string_view name, const std::vector<treesitter::PathContext> &contexts)
+{
+    index.push_back({offset, contexts.size(), names.size(), name.size()});
+    names += name;
+
+    for (const auto &ctx : contexts) {
+        append(asBytes(ContextRecord{ctx.path, 0, ctx.from, ctx.terminal}));
+    }
+}
+
+void
+extractor::ContextFileWriter::close()
+{
+    if (closed) {
+        return;
+    }
+    closed = true;
+
+    ContextFileHeader header{};
+    std::memcpy(header.magic, contextFileMagic, sizeof(header.magic));
+    header.version = contextFileVersion;
+    header.numFiles = index.size();
+    header.numPaths = interner.size();
+
+    std::vector<uint64_t> pathOffsets{0};
+    std::string pathBytes;
+    for (uint32_t id = 0; id < header.numPaths; ++id) {
+        pathBytes += interner.toString(id);
+        pathOffsets.push_back(pathBytes.size());
+    }
+    header.pathsOffset = offset;
+    append(asBytes(pathOffsets));
+    append(pathBytes);
+    align();
+
+    // names' offsets are relative so far
+    header.namesOffset = offset;
+    append(names);
+    align();
+    for (auto &entry : index) {
+        entry.nameOffset += header.namesOffset;
+    }
+
+    header.indexOffset = offset;
+    append(asBytes(index));
+
+    out.overwrite(0, asBytes(header));
+}
+
+extractor::ContextFileWriter::~ContextFileWriter()
+{
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+extractor::ContextFileReader::ContextFileReader(const std::filesystem::path &file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::format("Unable to open {}: {}", file.string(), strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        ::close(fd);
+        throw std::format("Unable to stat {}: {}", file.string(), strerror(errno));
+    }
+    size = st.st_size;
+    if (size < sizeof(ContextFileHeader)) {
+        ::close(fd);
+        throw std::format("{} is not a path-context file!", file.string());
+    }
+
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        throw std::format("Unable to map {}: {}", file.string(), strerror(errno));
+    }
+    data = static_cast<const std::byte *>(addr);
+
+    header = reinterpret_cast<const ContextFileHeader *>(data);
+    if (std::memcmp(header->magic, contextFileMagic, sizeof(header->magic)) != 0 ||
+        header->version != contextFileVersion) {
+        munmap(addr, size);
+        throw std::format("{} is not a path-context file of version {}!", file.string(), contextFileVersion);
+    }
+    if (auto error = validate(data, size); !error.empty()) {
+        munmap(addr, size);
+        throw std::format("{} is corrupted: {}!", file.string(), error);
+    }
+
+    pathOffsets = reinterpret_cast<const uint64_t *>(data + header->pathsOffset);
+    pathBytes = reinterpret_cast<const char *>(pathOffsets + header->numPaths + 1);
+    index = reinterpret_cast<const FileIndexEntry *>(data + header->indexOffset);
+}
+
+size_t
+extractor::ContextFileReader::fileCount() const
+{
+    return header->numFiles;
+}
+
+size_t
+extractor::ContextFileReader::pathCount() const
+{
+    return header->numPaths;
+}
+
+std::string_view
+extractor::ContextFileReader::fileName(size_t i) const
+{
+    return {reinterpret_cast<const char *>(data + index[i].nameOffset), index[i].nameSize};
+}
+
+std::span<const extractor::ContextRecord>
+extractor::ContextFileReader::contexts(size_t i) const
+{
+    return {reinterpret_cast<const ContextRecord *>(data + index[i].offset), index[i].count};
+}
+
+std::string_view
+extractor::ContextFileReader::path(uint32_t id) const
+{
+    return {pathBytes + pathOffsets[id], pathOffsets[id + 1] - pathOffsets[id]};
+}
+
+extractor::ContextFileReader::~ContextFileReader()
+{
+    munmap(const_cast<std::byte *>(data), size);
+}
@@ -1 +1,12 @@
 #include <extractor/Extractor.h>
+
+void
+extractor::writePaths(const treesitter::PathInterner &paths, const std::filesystem::path &file)
+{
+    BufferedSink out(file);
+    auto size = paths.size();
+    out.write(std::format("{}\n", size));
+    for (uint32_t id = 0; id < size; ++id) {
+        out.write(std::format("{} {}\n", id, paths.toString(id)));
+    }
+}
@@ -0,0 +1,59 @@
+#include <extractor/Vocabulary.h>
+#include <extractor/BufferedSink.h>
+#include <algorithm>
+#include <format>
+#include <mutex>
+#include <vector>
+
+extractor::Vocabulary::Shard &
+extractor::Vocabulary::shard(size_t hash)
+{
+    // low bits are used by the shards' own hash tables
+    return shards[(hash >> 32) % numShards];
+}
+
+void
+extractor::Vocabulary::insert(size_t hash, std::string_view name)
+{
+    auto &s = shard(hash);
+    {
+        std::shared_lock lk(s.m);
+        if (s.map.contains(hash)) {
+            return;
+        }
+    }
+    std::unique_lock lk(s.m);
+    s.map.try_emplace(hash, name);
+}
+
+size_t
+extractor::Vocabulary::size()
+{
+    size_t res = 0;
+    for (auto &s : shards) {
+        std::shared_lock lk(s.m);
+        res += s.map.size();
+    }
+    return res;
+}
+
+void
+extractor::Vocabulary::write(const std::filesystem::path &file, std::string_view header)
+{
+    // sorted by hash, so the file doesn't depend on the order files were processed in
+    std::vector<std::pair<size_t, std::string_view>> entries;
+    for (auto &s : shards) {
+        std::shared_lock lk(s.m);
+        for (auto &[hash, tok] : s.map) {
+            entries.emplace_back(hash, tok);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    BufferedSink out(file);
+    out.write(header);
+    out.write(std::format("{}\n", entries.size()));
+    for (auto &[hash, tok] : entries) {
+        out.write(std::format("___[BOS]___ {} {}\n", hash, tok));
+    }
+}
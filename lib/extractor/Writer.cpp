@@ -0,0 +1,225 @@
+#include <extractor/Writer.h>
+#include <support/Profiler/Profiler.h>
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <tuple>
+
+namespace
+{
+/// A function to write one line of a text output
+/// @param out sink of the output
+/// @param res result of one file
+/// @param interned whether the line is rendered from interned path-contexts
+template <typename Sink>
+void
+writeLine(Sink &out, const extractor::FileResult &res, bool interned)
+{
+    if (!interned) {
+        out.write(res.line);
+        return;
+    }
+    // <path id>_<hash> instead of <id><id>...<id>_<hash>, <hash>_<path id>_<hash> for leaf-to-leaf paths
+    std::string line = res.name;
+    for (const auto &ctx : res.contexts) {
+        if (ctx.from != 0) {
+            line += std::format(" {}_{}_{}", ctx.from, ctx.path, ctx.terminal);
+        } else {
+            line += std::format(" {}_{}", ctx.path, ctx.terminal);
+        }
+    }
+    line += "\n";
+    out.write(line);
+}
+} // namespace
+
+void
+extractor::TextOutput::write(const FileResult &res)
+{
+    writeLine(out, res, interned);
+}
+
+void
+extractor::TextOutput::close()
+{
+    out.flush();
+}
+
+void
+extractor::CompressedTextOutput::write(const FileResult &res)
+{
+    writeLine(out, res, interned);
+}
+
+void
+extractor::CompressedTextOutput::close()
+{
+    out.close();
+}
+
+void
+extractor::BinaryOutput::write(const FileResult &res)
+{
+    out.write(res.name, res.contexts);
+}
+
+void
+extractor::BinaryOutput::close()
+{
+    out.close();
+}
+
+extractor::SortedOutput::SortedOutput(std::unique_ptr<ContextOutput> out, const std::filesystem::path &file,
+                                      treesitter::PathInterner &interner)
+    : inner(std::move(out)), paths(interner), spillFile(file), spill(file)
+{
+}
+
+void
+extractor::SortedOutput::write(const FileResult &res)
+{
+    // <line size><line><number of contexts><contexts>
+    std::string buf;
+    uint64_t lineSize = res.line.size();
+    uint64_t numContexts = res.contexts.size();
+    buf.append(reinterpret_cast<const char *>(&lineSize), sizeof(lineSize));
+    buf.append(res.line);
+    buf.append(reinterpret_cast<const char *>(&numContexts), sizeof(numContexts));
+    buf.append(reinterpret_cast<const char *>(res.contexts.data()), numContexts * sizeof(treesitter::PathContext));
+
+    spill.write(buf);
+    index.push_back({res.name, res.source, offset, buf.size()});
+    offset += buf.size();
+}
+
+void
+extractor::SortedOutput::close()
+{
+    spill.flush();
+    const auto &canonical = paths.canonicalize();
+
+    std::sort(index.begin(), index.end(),
+              [](const Entry &a, const Entry &b) { return std::tie(a.name, a.source) < std::tie(b.name, b.source); });
+
+    std::ifstream in(spillFile, std::ios::binary);
+    std::string buf;
+    for (const auto &entry : index) {
+        buf.resize(entry.size);
+        in.seekg(entry.offset);
+        in.read(buf.data(), entry.size);
+        if (!in) {
+            throw std::format("Unable to read {}", spillFile.string());
+        }
+
+        FileResult res{entry.name, entry.source};
+        uint64_t lineSize, numContexts;
+        std::memcpy(&lineSize, buf.data(), sizeof(lineSize));
+        res.line.assign(buf.data() + sizeof(lineSize), lineSize);
+        std::memcpy(&numContexts, buf.data() + sizeof(lineSize) + lineSize, sizeof(numContexts));
+        res.contexts.resize(numContexts);
+        std::memcpy(res.contexts.data(), buf.data() + 2 * sizeof(uint64_t) + lineSize,
+                    numContexts * sizeof(treesitter::PathContext));
+        for (auto &ctx : res.contexts) {
+            ctx.path = canonical[ctx.path];
+        }
+
+        inner->write(res);
+    }
+    in.close();
+    std::filesystem::remove(spillFile);
+
+    inner->close();
+}
+
+uint64_t
+extractor::nameHash(std::string_view name)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+extractor::Writer::Writer(std::vector<std::unique_ptr<ContextOutput>> outs, size_t capacity,
+                          threadpool::QueueKind queue)
+    : slots(capacity), outputs(std::move(outs))
+{
+    if (queue == threadpool::QueueKind::LockFree) {
+        resultsRing.emplace(capacity);
+    }
+    thread = std::jthread([this] { loop(); });
+}
+
+void
+extractor::Writer::push(FileResult &&res)
+{
+    slots.acquire();
+    if (resultsRing) {
+        resultsRing->push(std::move(res));
+    } else {
+        results.push(std::move(res));
+    }
+    items.release();
+}
+
+void
+extractor::Writer::loop()
+{
+    while (true) {
+        items.acquire();
+        auto res = resultsRing ? resultsRing->pop() : results.pop();
+        while (!res.has_value()) {
+            if (closing.load(std::memory_order_acquire)) {
+                // all results are published once the input is over, so the queue is drained
+                return;
+            }
+            // a lock-free ring has nothing to pop while an earlier cell is claimed by a producer but not published
+            std::this_thread::yield();
+            res = resultsRing ? resultsRing->pop() : results.pop();
+        }
+        slots.release();
+        if (error) {
+            // results are still popped after a failure, so producers waiting for a slot aren't blocked
+            continue;
+        }
+
+        auto &output = outputs.size() == 1 ? outputs[0] : outputs[nameHash(res->name) % outputs.size()];
+        profiler::ScopedTimer timer(profiler::Stage::Write);
+        try {
+            output->write(*res);
+        } catch (...) {
+            error = std::current_exception();
+        }
+    }
+}
+
+void
+extractor::Writer::close()
+{
+    if (!thread.joinable()) {
+        return;
+    }
+    // wake the writer up without a result
+    closing.store(true, std::memory_order_release);
+    items.release();
+    thread.join();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    for (auto &output : outputs) {
+        // sorted outputs are replayed and compressed outputs drained here, so it's one more write sample
+        profiler::ScopedTimer timer(profiler::Stage::Write);
+        output->close();
+    }
+}
+
+extractor::Writer::~Writer()
+{
+    try {
+        close();
+    } catch (...) {
+    }
+}
@@ -0,0 +1,104 @@
+#include <support/Hash/Hash.h>
+#include <bit>
+#include <cstring>
+#include <format>
+
+namespace
+{
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+/// A function to read an unaligned little-endian integer
+template <typename T>
+T
+read(const char *p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    if constexpr (std::endian::native == std::endian::big) {
+        value = std::byteswap(value);
+    }
+    return value;
+}
+
+uint64_t
+round(uint64_t acc, uint64_t input)
+{
+    acc += input * prime2;
+    acc = std::rotl(acc, 31);
+    return acc * prime1;
+}
+
+uint64_t
+mergeRound(uint64_t acc, uint64_t value)
+{
+    acc ^= round(0, value);
+    return acc * prime1 + prime4;
+}
+
+uint64_t
+avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= prime2;
+    h ^= h >> 29;
+    h *= prime3;
+    h ^= h >> 32;
+    return h;
+}
+} // namespace
+
+uint64_t
+hashing::xxh64(std::string_view data, uint64_t seed)
+{
+    const char *p = data.data();
+    const char *end = p + data.size();
+    uint64_t h;
+
+    if (data.size() >= 32) {
+        // 4 independent lanes over 32-byte stripes
+        uint64_t v1 = seed + prime1 + prime2;
+        uint64_t v2 = seed + prime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - prime1;
+        for (; end - p >= 32; p += 32) {
+            v1 = round(v1, read<uint64_t>(p));
+            v2 = round(v2, read<uint64_t>(p + 8));
+            v3 = round(v3, read<uint64_t>(p + 16));
+            v4 = round(v4, read<uint64_t>(p + 24));
+        }
+        h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + prime5;
+    }
+    h += data.size();
+
+    // the tail
+    for (; end - p >= 8; p += 8) {
+        h ^= round(0, read<uint64_t>(p));
+        h = std::rotl(h, 27) * prime1 + prime4;
+    }
+    if (end - p >= 4) {
+        h ^= read<uint32_t>(p) * prime1;
+        h = std::rotl(h, 23) * prime2 + prime3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= static_cast<unsigned char>(*p) * prime5;
+        h = std::rotl(h, 11) * prime1;
+    }
+    return avalanche(h);
+}
+
+std::string
+hashing::header(uint64_t seed)
+{
+    return std::format("#hash {} {}\n", algorithm, seed);
+}
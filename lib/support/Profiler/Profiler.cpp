@@ -0,0 +1,154 @@
+#include <support/Profiler/Profiler.h>
+#include <bit>
+#include <format>
+#include <fstream>
+
+namespace
+{
+/// @param ns duration
+/// @return index of the duration's bucket: exact below 8, otherwise the power of 2 and the next 3 bits
+size_t
+bucketOf(uint64_t ns)
+{
+    if (ns < 8) {
+        return ns;
+    }
+    size_t msb = 63 - std::countl_zero(ns);
+    return (msb - 2) * 8 + ((ns >> (msb - 3)) & 7);
+}
+
+/// @param i index of a bucket
+/// @return the largest duration of the bucket
+uint64_t
+bucketUpperBound(size_t i)
+{
+    if (i < 8) {
+        return i;
+    }
+    size_t msb = i / 8 + 2;
+    uint64_t lower = (8 + i % 8) << (msb - 3);
+    return lower + (uint64_t(1) << (msb - 3)) - 1;
+}
+} // namespace
+
+void
+profiler::Profiler::Histogram::add(uint64_t ns)
+{
+    ++buckets[bucketOf(ns)];
+    ++count;
+    total += ns;
+    max = std::max(max, ns);
+}
+
+void
+profiler::Profiler::Histogram::merge(const Histogram &other)
+{
+    for (size_t i = 0; i < numBuckets; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    total += other.total;
+    max = std::max(max, other.max);
+}
+
+uint64_t
+profiler::Profiler::Histogram::quantile(double q) const
+{
+    // rank of the quantile, 1-based
+    uint64_t rank = std::max<uint64_t>(1, q * count + 0.5);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < numBuckets; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+profiler::Profiler &
+profiler::Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+profiler::Profiler::ThreadStats &
+profiler::Profiler::local()
+{
+    // registered on the first use, there's only one profiler per process
+    thread_local ThreadStats *stats = nullptr;
+    if (stats == nullptr) {
+        std::lock_guard lk(m);
+        stats = threads.emplace_back(std::make_unique<ThreadStats>()).get();
+    }
+    return *stats;
+}
+
+void
+profiler::Profiler::enable()
+{
+    start = std::chrono::steady_clock::now();
+    enabled.store(true, std::memory_order_relaxed);
+}
+
+void
+profiler::Profiler::record(Stage stage, uint64_t ns)
+{
+    local().stages[size_t(stage)].add(ns);
+}
+
+void
+profiler::Profiler::add(Counter counter, uint64_t n)
+{
+    local().counters[size_t(counter)] += n;
+}
+
+void
+profiler::Profiler::report(const std::filesystem::path &file)
+{
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    ThreadStats total;
+    size_t numThreads;
+    {
+        std::lock_guard lk(m);
+        numThreads = threads.size();
+        for (const auto &stats : threads) {
+            for (size_t i = 0; i < total.stages.size(); ++i) {
+                total.stages[i].merge(stats->stages[i]);
+            }
+            for (size_t i = 0; i < total.counters.size(); ++i) {
+                total.counters[i] += stats->counters[i];
+            }
+        }
+    }
+
+    std::ofstream out(file);
+    out << "{\n";
+    out << std::format("  \"wall_seconds\": {:.3f},\n", wall);
+    out << std::format("  \"threads\": {},\n", numThreads);
+    for (size_t i = 0; i < total.counters.size(); ++i) {
+        out << std::format("  \"{}\": {},\n", counterNames[i], total.counters[i]);
+    }
+    auto files = total.counters[size_t(Counter::Files)];
+    out << std::format("  \"files_per_second\": {:.1f},\n", wall > 0 ? files / wall : 0.0);
+    auto lookups = total.counters[size_t(Counter::MemoLookups)];
+    auto hits = total.counters[size_t(Counter::MemoHits)];
+    out << std::format("  \"memo_hit_rate\": {:.4f},\n", lookups > 0 ? double(hits) / lookups : 0.0);
+
+    // times are summed over all threads, so stages running in parallel may exceed the wall time
+    out << "  \"stages\": {\n";
+    for (size_t i = 0; i < total.stages.size(); ++i) {
+        const auto &h = total.stages[i];
+        out << std::format("    \"{}\": {{\"count\": {}, \"total_ms\": {:.3f}, \"mean_us\": {:.3f}, "
+                           "\"p99_us\": {:.3f}, \"max_us\": {:.3f}}}{}\n",
+                           stageNames[i], h.count, h.total / 1e6, h.count > 0 ? h.total / 1e3 / h.count : 0.0,
+                           h.quantile(0.99) / 1e3, h.max / 1e3, i + 1 < total.stages.size() ? "," : "");
+    }
+    out << "  }\n";
+    out << "}\n";
+    if (!out) {
+        throw std::format("Unable to write {}", file.string());
+    }
+}
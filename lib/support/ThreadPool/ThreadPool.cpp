@@ -1,61 +1,185 @@
 #include <support/ThreadPool/ThreadPool.h>
+#include <format>
 
-threadpool::ThreadPool::ThreadPool(size_t numThreads) : tasks(numThreads)
+namespace
 {
+// Pool and index of the calling thread's worker, nullptr for threads outside pools
+struct CurrentWorker {
+    const threadpool::ThreadPool *pool = nullptr;
+    size_t index = 0;
+};
+
+thread_local CurrentWorker current;
+
+// xorshift64, workers only need a cheap spread of victims
+uint64_t
+nextRandom(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+} // namespace
+
+threadpool::ThreadPool::ThreadPool(size_t numThreads, size_t capacity, QueueKind queue)
+    : workers(numThreads), capacity(capacity)
+{
+    if (queue == QueueKind::LockFree) {
+        if (capacity == 0) {
+            throw std::format("A lock-free queue of tasks needs a bounded pool!");
+        }
+        injectedRing.emplace(capacity);
+    }
     for (size_t i = 0; i < numThreads; ++i) {
-        // the i'th worker is doing its job...
-        workers.push(size_t(i));
-
-        threads.emplace_back([&, i](const std::stop_token &stop_tok) {
-            while (!stop_tok.stop_requested()) {
-                // enter the critical section
-                tasks[i].semaphore.acquire();
-                // while still there're tasks in a queue
-                while (waitingTasks.load(std::memory_order_acquire) > 0) {
-                    while (auto task = tasks[i].tasks.pop()) {
-                        // decrease the number of waiting tasks
-                        waitingTasks.fetch_sub(1, std::memory_order_release);
-                        // process the given task
-                        std::invoke(std::move(task.value()));
-                        // decrease the total number of tasks
-                        totalLeftTasks.fetch_sub(1, std::memory_order_release);
-                    }
-                    // if the i'th worker has processed all its tasks, it can do non-processed tasks of another
-                    // workers
-                    for (size_t j = 1; j < tasks.size(); ++j) {
-                        auto workerIdx = (i + j) % tasks.size();
-                        if (auto task = tasks[workerIdx].tasks.pop()) {
-                            // decrease the number of waiting tasks
-                            waitingTasks.fetch_sub(1, std::memory_order_release);
-                            // process the given task
-                            std::invoke(std::move(task.value()));
-                            // decrease the total number of tasks
-                            totalLeftTasks.fetch_sub(1, std::memory_order_release);
-                            break;
-                        }
-                    }
-                }
-
-                // if all tasks were processed, finish job
-                if (totalLeftTasks.load(std::memory_order_acquire) == 0) {
-                    doneThreads.store(true, std::memory_order_release);
-                    doneThreads.notify_one();
-                }
+        threads.emplace_back([this, i] { work(i); });
+    }
+}
+
+size_t
+threadpool::ThreadPool::self() const
+{
+    return current.pool == this ? current.index : workers.size();
+}
+
+bool
+threadpool::ThreadPool::reserve(bool wait)
+{
+    size_t n = waiting.load(std::memory_order_relaxed);
+    while (true) {
+        if (n < capacity) {
+            if (waiting.compare_exchange_weak(n, n + 1, std::memory_order_relaxed)) {
+                return true;
             }
-        });
+            continue;
+        }
+        if (!wait) {
+            return false;
+        }
+        // a worker taking a task after this point sees the waiter and wakes it up
+        blocked.fetch_add(1, std::memory_order_seq_cst);
+        waiting.wait(n, std::memory_order_seq_cst);
+        blocked.fetch_sub(1, std::memory_order_relaxed);
+        n = waiting.load(std::memory_order_relaxed);
+    }
+}
+
+bool
+threadpool::ThreadPool::submit(Job *job, bool wait)
+{
+    size_t i = self();
+    // a worker never waits for a place: all workers could wait for each other
+    if (capacity > 0 && !reserve(wait && i == workers.size())) {
+        if (wait) {
+            // the pool is full, so the worker has something to do anyway
+            std::invoke(std::move(*job));
+            delete job;
+            return true;
+        }
+        delete job;
+        return false;
+    }
+    leftTasks.fetch_add(1, std::memory_order_relaxed);
+    if (i < workers.size()) {
+        // a task submits a task: no locks
+        workers[i].deque.push(job);
+    } else {
+        if (injectedRing) {
+            injectedRing->push(std::move(job));
+        } else {
+            injected.push(std::move(job));
+        }
+        numInjected.fetch_add(1, std::memory_order_release);
+    }
+    // a worker going to sleep sees the new value and doesn't sleep, a sleeping one is woken up
+    wakeups.fetch_add(1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst) > 0) {
+        wakeups.notify_one();
+    }
+    return true;
+}
+
+threadpool::ThreadPool::Job *
+threadpool::ThreadPool::find(size_t i, uint64_t &random)
+{
+    if (auto job = workers[i].deque.take()) {
+        return job;
+    }
+    if (numInjected.load(std::memory_order_acquire) > 0) {
+        if (auto job = injectedRing ? injectedRing->pop() : injected.pop()) {
+            numInjected.fetch_sub(1, std::memory_order_relaxed);
+            return *job;
+        }
+    }
+    // start from a random victim, so thieves don't line up behind the same worker
+    size_t n = workers.size();
+    size_t start = nextRandom(random) % n;
+    for (size_t k = 0; k < n; ++k) {
+        size_t victim = (start + k) % n;
+        if (victim == i) {
+            continue;
+        }
+        if (auto job = workers[victim].deque.steal()) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void
+threadpool::ThreadPool::run(Job *job)
+{
+    // the task is no longer waiting, so its place is free
+    if (capacity > 0) {
+        waiting.fetch_sub(1, std::memory_order_seq_cst);
+        if (blocked.load(std::memory_order_seq_cst) > 0) {
+            waiting.notify_one();
+        }
+    }
+    std::invoke(std::move(*job));
+    delete job;
+    // the last task wakes up the destructor
+    if (leftTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        leftTasks.notify_all();
+    }
+}
+
+void
+threadpool::ThreadPool::work(size_t i)
+{
+    current = {this, i};
+    uint64_t random = 0x9E3779B97F4A7C15ull * (i + 1);
+    while (true) {
+        if (auto job = find(i, random)) {
+            run(job);
+            continue;
+        }
+        // look once more after reading the counter, a submission after this point changes it
+        auto epoch = wakeups.load(std::memory_order_seq_cst);
+        if (auto job = find(i, random)) {
+            run(job);
+            continue;
+        }
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+        sleeping.fetch_add(1, std::memory_order_seq_cst);
+        wakeups.wait(epoch, std::memory_order_seq_cst);
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
     }
 }
 
 threadpool::ThreadPool::~ThreadPool()
 {
     // wait until all tasks are processed
-    if (totalLeftTasks.load(std::memory_order_acquire) > 0) {
-        doneThreads.wait(false);
-    }
-    // finishing processing: stopping threads and releasing the corresponding semaphores
-    for (size_t i = 0; i < threads.size(); ++i) {
-        threads[i].request_stop();
-        tasks[i].semaphore.release();
-        threads[i].join();
+    for (size_t left; (left = leftTasks.load(std::memory_order_acquire)) > 0;) {
+        leftTasks.wait(left);
+    }
+    // finishing processing: waking up and stopping threads
+    stopping.store(true, std::memory_order_release);
+    wakeups.fetch_add(1, std::memory_order_seq_cst);
+    wakeups.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
     }
 }
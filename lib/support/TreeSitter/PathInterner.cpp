@@ -0,0 +1,132 @@
+#include <support/TreeSitter/PathInterner.h>
+#include <algorithm>
+#include <bit>
+#include <format>
+
+const treesitter::PathInterner::Node *
+treesitter::PathInterner::root() const
+{
+    return &rootNode;
+}
+
+const treesitter::PathInterner::Node *
+treesitter::PathInterner::child(const Node *parent, TSSymbol symbol)
+{
+    // nodes are never moved, so the parent's address identifies it (user-space addresses fit in 48 bits)
+    uint64_t key = (reinterpret_cast<uintptr_t>(parent) << 16) | symbol;
+    // Fibonacci hashing: the top bits of the product depend on all bits of the key
+    auto &shard = shards[(key * 0x9E3779B97F4A7C15ull) >> (64 - std::countr_zero(numShards))];
+    {
+        std::shared_lock lk(shard.m);
+        auto it = shard.nodes.find(key);
+        if (it != shard.nodes.end()) {
+            return &it->second;
+        }
+    }
+    std::unique_lock lk(shard.m);
+    auto [it, inserted] = shard.nodes.try_emplace(key, parent, symbol, parent->depth + 1);
+    return &it->second;
+}
+
+uint32_t
+treesitter::PathInterner::pathId(const Node *node)
+{
+    auto id = node->path.load(std::memory_order_acquire);
+    if (id != none) {
+        return id;
+    }
+    std::lock_guard lk(pathsMutex);
+    id = node->path.load(std::memory_order_relaxed);
+    if (id == none) {
+        id = paths.size();
+        paths.push_back(node);
+        node->path.store(id, std::memory_order_release);
+    }
+    return id;
+}
+
+uint32_t
+treesitter::PathInterner::intern(std::span<const TokenizedToken> pathContext)
+{
+    auto node = root();
+    for (const auto &token : pathContext) {
+        node = child(node, token.symbol);
+    }
+    return pathId(node);
+}
+
+const std::vector<uint32_t> &
+treesitter::PathInterner::canonicalize()
+{
+    std::lock_guard lk(pathsMutex);
+    if (canonical.size() == paths.size()) {
+        return canonical;
+    }
+
+    std::vector<std::pair<std::vector<TSSymbol>, uint32_t>> order;
+    order.reserve(paths.size());
+    for (uint32_t id = 0; id < paths.size(); ++id) {
+        order.emplace_back(symbols(paths[id]), id);
+    }
+    std::sort(order.begin(), order.end());
+
+    // apply the new numbering on top of the previous one, if any
+    std::vector<uint32_t> mapping(paths.size());
+    std::vector<const Node *> sorted(paths.size());
+    for (uint32_t id = 0; id < order.size(); ++id) {
+        auto old = order[id].second;
+        mapping[old] = id;
+        sorted[id] = paths[old];
+        sorted[id]->path.store(id, std::memory_order_release);
+    }
+    for (auto &id : canonical) {
+        id = mapping[id];
+    }
+    for (auto id = canonical.size(); id < paths.size(); ++id) {
+        canonical.push_back(mapping[id]);
+    }
+    paths = std::move(sorted);
+    return canonical;
+}
+
+size_t
+treesitter::PathInterner::size() const
+{
+    std::lock_guard lk(pathsMutex);
+    return paths.size();
+}
+
+std::vector<treesitter::TSSymbol>
+treesitter::PathInterner::symbols(const Node *node)
+{
+    std::vector<TSSymbol> res(node->depth);
+    for (; node->parent != nullptr; node = node->parent) {
+        res[node->depth - 1] = node->symbol;
+    }
+    return res;
+}
+
+std::vector<treesitter::TSSymbol>
+treesitter::PathInterner::symbols(uint32_t id) const
+{
+    const Node *node;
+    {
+        std::lock_guard lk(pathsMutex);
+        node = paths.at(id);
+    }
+    return symbols(node);
+}
+
+std::string
+treesitter::PathInterner::toString(uint32_t id) const
+{
+    std::string res;
+    for (auto symbol : symbols(id)) {
+        if (symbol == turnSymbol) {
+            res += '^';
+        } else {
+            res += std::format("{:0>3}", symbol);
+        }
+    }
+    return res;
+}
@@ -0,0 +1,27 @@
+#include <support/TreeSitter/ScratchArena.h>
+
+namespace
+{
+/// A function to get the arena slot of the calling thread
+std::unique_ptr<treesitter::Arena> &
+threadArena()
+{
+    thread_local std::unique_ptr<treesitter::Arena> arena;
+    return arena;
+}
+} // namespace
+
+treesitter::ScratchArena::ScratchArena() : arena(threadArena())
+{
+    if (arena == nullptr) {
+        arena = std::make_unique<Arena>();
+    }
+}
+
+treesitter::ScratchArena::~ScratchArena()
+{
+    if (arena != nullptr) {
+        // blocks taken from the heap are freed, the next file starts at the beginning of the first block
+        arena->resource.release();
+    }
+}
@@ -0,0 +1,91 @@
+#include <support/TreeSitter/SourceBuffer.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <utility>
+
+treesitter::SourceBuffer::SourceBuffer(const std::filesystem::path &file)
+{
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+
+    size_t size = st.st_size;
+    if (size >= mmapThreshold) {
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            // the whole file is going to be parsed
+            madvise(addr, size, MADV_SEQUENTIAL);
+            close(fd);
+            ptr = static_cast<const char *>(addr);
+            len = size;
+            mapped = true;
+            return;
+        }
+    }
+
+    // small file (or mmap isn't possible)
+    storage.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        auto n = read(fd, storage.data() + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += n;
+    }
+    close(fd);
+    storage.resize(done);
+    ptr = storage.data();
+    len = storage.size();
+}
+
+treesitter::SourceBuffer::SourceBuffer(SourceBuffer &&other) noexcept
+    : ptr(std::exchange(other.ptr, nullptr)), len(std::exchange(other.len, 0)),
+      mapped(std::exchange(other.mapped, false)), storage(std::move(other.storage))
+{
+    if (!mapped) {
+        ptr = storage.data();
+    }
+}
+
+treesitter::SourceBuffer &
+treesitter::SourceBuffer::operator=(SourceBuffer &&other) noexcept
+{
+    if (this != &other) {
+        release();
+        ptr = std::exchange(other.ptr, nullptr);
+        len = std::exchange(other.len, 0);
+        mapped = std::exchange(other.mapped, false);
+        storage = std::move(other.storage);
+        if (!mapped) {
+            ptr = storage.data();
+        }
+    }
+    return *this;
+}
+
+void
+treesitter::SourceBuffer::release()
+{
+    if (mapped) {
+        munmap(const_cast<char *>(ptr), len);
+        mapped = false;
+    }
+}
+
+treesitter::SourceBuffer::~SourceBuffer()
+{
+    release();
+}
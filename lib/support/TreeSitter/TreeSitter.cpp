@@ -1,8 +1,11 @@
 #include <support/TreeSitter/TreeSitter.h>
+#include <support/Profiler/Profiler.h>
 #include <stdint.h>
 #include <fstream>
 #include <sstream>
 #include <optional>
+#include <charconv>
+#include <mutex>
 
 treesitter::TreeSitterNode &
 treesitter::TreeSitterNode::operator=(const TreeSitterNode &other)
@@ -116,29 +119,89 @@ treesitter::TreeSitterNode::isFork() const
     }
 }
 
-treesitter::TreeSitter::TreeSitter(const std::string &buf, const std::string &lang, int opt)
+namespace
+{
+/// Extensions of C files, headers are considered to be C
+constexpr std::string_view cExtensions[] = {".c", ".h"};
+/// Extensions of C++ files
+constexpr std::string_view cppExtensions[] = {".cpp", ".cc", ".cxx", ".c++", ".C", ".hpp", ".hh", ".hxx"};
+
+/// Supported languages, a language's id is its index
+const treesitter::Language registry[] = {
+    {0, "c", treesitter::tree_sitter_c, cExtensions},
+    {1, "cpp", treesitter::tree_sitter_cpp, cppExtensions},
+};
+} // namespace
+
+std::span<const treesitter::Language>
+treesitter::LanguageRegistry::all()
+{
+    return registry;
+}
+
+const treesitter::Language &
+treesitter::LanguageRegistry::byName(std::string_view name)
+{
+    for (const auto &lang : registry) {
+        if (lang.name == name) {
+            return lang;
+        }
+    }
+    throw std::format("Unknown language {}", name);
+}
+
+const treesitter::Language *
+treesitter::LanguageRegistry::byExtension(const std::filesystem::path &file)
+{
+    auto ext = file.extension().string();
+    for (const auto &lang : registry) {
+        if (std::ranges::find(lang.extensions, ext) != lang.extensions.end()) {
+            return &lang;
+        }
+    }
+    return nullptr;
+}
+
+namespace
 {
-    std::ifstream file(buf);
-    std::stringstream ss;
-    ss << file.rdbuf();
-    file.close();
+/// Parsers of one thread
+struct ThreadParsers {
+    /// language -> parser
+    std::unordered_map<const treesitter::TSLanguage *, treesitter::TSParser *> parsers;
+
+    ~ThreadParsers()
+    {
+        for (auto &[lang, parser] : parsers) {
+            treesitter::ts_parser_delete(parser);
+        }
+    }
+};
+} // namespace
 
-    src = ss.str();
+treesitter::TSTree *
+treesitter::ParserCache::parse(const TSLanguage *lang, const char *src, uint32_t length)
+{
+    thread_local ThreadParsers cache;
+    auto &parser = cache.parsers[lang];
+    if (parser == nullptr) {
+        parser = ts_parser_new();
+        ts_parser_set_language(parser, lang);
+    }
+    auto tree = ts_parser_parse_string(parser, NULL, src, length);
+    ts_parser_reset(parser);
+    return tree;
+}
+
+treesitter::TreeSitter::TreeSitter(const std::string &buf, const std::string &lang, int opt)
+{
+    src = std::make_shared<SourceBuffer>(buf);
     option = opt;
-    parser = ts_parser_new();
-    const TSLanguage *lang_parser;
-    if (lang == "c") {
-        lang_parser = tree_sitter_c();
-    } else if (lang == "cpp") {
-        lang_parser = tree_sitter_cpp();
-    };
-    ts_parser_set_language(parser, lang_parser);
-    tree = ts_parser_parse_string(parser, NULL, src.c_str(), strlen(src.c_str()));
+    const TSLanguage *lang_parser = LanguageRegistry::byName(lang).grammar();
+    tree = ParserCache::parse(lang_parser, src->view().data(), src->view().size());
 }
 
 treesitter::TreeSitter::TreeSitter(const TreeSitter &other)
 {
-    parser = other.parser;
     tree = other.tree;
     src = other.src;
 }
@@ -158,14 +221,13 @@ treesitter::TreeSitter::getGraph(const char *file)
 
 treesitter::TreeSitter::~TreeSitter()
 {
-    ts_parser_delete(parser);
     ts_tree_delete(tree);
 }
 
-std::string
+std::string_view
 treesitter::TreeSitter::getContext() const
 {
-    return src;
+    return src->view();
 }
 
 std::vector<std::vector<treesitter::TreeSitterNode>>
@@ -206,168 +268,164 @@ treesitter::root2leafPaths(TreeSitterNode root, bool reverseArr)
     return res;
 }
 
-std::vector<std::vector<treesitter::TSNode>>
-treesitter::Traversal::getAllNode2TerminalPaths(const TSNode &node, bool reverseArr)
+treesitter::TokenizedToken
+treesitter::Tokenizer::defaultToken(const TSNode &node, std::string_view src, std::pmr::string &text)
 {
-    // vector of all possible r2l paths
-    std::vector<std::vector<TSNode>> res;
-
-    // a root2terminal path
-    std::vector<TSNode> stack;
-
-    TSTreeCursor cursor = ts_tree_cursor_new(node);
-    TSNode curNode = ts_tree_cursor_current_node(&cursor);
-    stack.push_back(curNode);
-
-    int isNew = true;
-
-    while (1) {
-        if (isNew && ts_tree_cursor_goto_first_child(&cursor)) {
-            // to child (down)
-            curNode = ts_tree_cursor_current_node(&cursor);
-            stack.push_back(curNode);
+    size_t name;
+    if (!ts_node_is_null(node) && ts_node_child_count(node) == 0) {
+        // terminal
+        std::string_view tempName;
+        if (ts_node_is_named(node) && std::string_view(ts_node_grammar_type(node)) != "identifier") {
+            // named terminal => exists in the grammar
+            size_t bytes = ts_node_end_byte(node) - ts_node_start_byte(node);
+            tempName = src.substr(ts_node_start_byte(node), bytes);
         } else {
-            // terminal || !isNew
-            if (isNew) {
-                // terminal -> add a new root-terminal path
-                auto vec = stack;
-                if (reverseArr) {
-                    std::reverse(vec.begin(), vec.end());
-                }
-                res.push_back(vec);
-            }
-            if (ts_tree_cursor_goto_next_sibling(&cursor)) {
-                // to sibling terminal (up-down)
-                stack.pop_back();
-                isNew = true;
-                curNode = ts_tree_cursor_current_node(&cursor);
-                stack.push_back(curNode);
-            } else if (ts_tree_cursor_goto_parent(&cursor)) {
-                // to parent (up)
-                isNew = false;
-                stack.pop_back();
-            } else {
-                stack.clear();
-                break;
-            }
+            // identifiers + unnamed
+            tempName = ts_node_grammar_type(node);
         }
+        // the value is hashed in place, it isn't copied
+        name = hashing::xxh64(tempName, seed);
+        // text keeps its capacity between terminals
+        text.assign(1, '[');
+        text.append(tempName);
+        text.push_back(']');
+    } else {
+        // non-terminal
+        name = 0;
     }
-
-    ts_tree_cursor_delete(&cursor);
-    return res;
-}
-
-std::vector<std::vector<treesitter::TSNode>>
-treesitter::Traversal::root2terminal(const TSNode &root)
-{
-    auto vec = getAllNode2TerminalPaths(root);
-    return vec;
+    return {name, ts_node_grammar_symbol(node)};
 }
 
-std::vector<std::vector<treesitter::TSNode>>
-treesitter::Traversal::terminal2terminal(const TSNode &root)
+bool
+treesitter::Tokenizer::defaultTerminal(const TSNode &node)
 {
-    auto vec = getAllNode2TerminalPaths(root);
-    /// @todo
-    return vec;
+    // remove comments
+    return !ts_node_is_extra(node);
 }
 
-std::optional<std::vector<treesitter::TokenizedToken>>
-treesitter::Tokenizer::defaultTokenization(const std::vector<TSNode> &nodes, const std::string &src,
-                                           std::unordered_map<size_t, std::string> &vocab)
+bool
+treesitter::Tokenizer::defaultFilter(std::span<const TSNode> nodes)
 {
-    // remove comments
-    if (ts_node_is_extra(nodes.back())) {
-        return std::nullopt;
+    if (!defaultTerminal(nodes.back())) {
+        return false;
     }
     // remove too short branches (e.g. #define ..., #include ...)
     if (nodes.size() < 5) {
-        return std::nullopt;
-    }
-    std::vector<TokenizedToken> res;
-    for (auto &node : nodes) {
-        std::string id = std::format("{:0>3}", ts_node_grammar_symbol(node));
-        size_t name;
-        if (!ts_node_is_null(node) && ts_node_child_count(node) == 0) {
-            // terminal
-            std::string tempName;
-            if (ts_node_is_named(node) && std::string_view(ts_node_grammar_type(node)) != "identifier") {
-                // named terminal => exists in the grammar
-                size_t bytes = ts_node_end_byte(node) - ts_node_start_byte(node);
-                tempName = src.substr(ts_node_start_byte(node), bytes);
-            } else {
-                // identifiers + unnamed
-                tempName = ts_node_grammar_type(node);
-            }
-            // add a terminal to vocabulary
-            name = std::hash<std::string>{}(tempName);
-            vocab[name] = "[" + tempName + "]";
-        } else {
-            // non-terminal
-            name = 0;
-        }
-        res.push_back(TokenizedToken(id, name));
+        return false;
     }
-
-    return res;
+    return true;
 }
 
-std::string
-treesitter::Split::toBranch(const std::vector<TokenizedToken> &pathContext)
+treesitter::SymbolEncoding::SymbolEncoding(const TSLanguage *lang)
 {
-    std::string res;
-    for (const auto &token : pathContext) {
-        res += token.id;
+    uint32_t count = ts_language_symbol_count(lang);
+    offsets.reserve(count + 1);
+    for (uint32_t symbol = 0; symbol < count; ++symbol) {
+        offsets.push_back(chars.size());
+        chars += std::format("{:0>3}", symbol);
     }
-    auto hashed = pathContext.back().name;
-    res += "_" + std::to_string(hashed);
+    offsets.push_back(chars.size());
+}
 
-    return res;
+const treesitter::SymbolEncoding &
+treesitter::SymbolEncoding::of(const TSLanguage *lang)
+{
+    static std::mutex mutex;
+    static std::unordered_map<const TSLanguage *, std::unique_ptr<SymbolEncoding>> tables;
+
+    std::lock_guard lock(mutex);
+    auto &table = tables[lang];
+    if (table == nullptr) {
+        table.reset(new SymbolEncoding(lang));
+    }
+    return *table;
 }
 
-treesitter::Tree::Tree(const std::string &fileName, const std::string &lang, const std::string &traversalParam,
-                       const std::string &tokenizationParam, const std::string &splitParam)
-    : traversal(traversalPolicy[traversalParam]), tokenizer(tokenizationRules[tokenizationParam]),
-      split(splitStrategy[splitParam])
+namespace
+{
+/// A function to append a number to a buffer without a temporary string
+void
+appendNumber(std::string &out, size_t value)
 {
-    std::ifstream file(fileName);
-    std::stringstream ss;
-    ss << file.rdbuf();
-    file.close();
+    char buf[20];
+    auto end = std::to_chars(buf, buf + sizeof(buf), value).ptr;
+    out.append(buf, end);
+}
 
-    src = ss.str();
-    parser = ts_parser_new();
+/// Upper bound of the length of a split path-context
+size_t
+splitSize(std::span<const treesitter::TokenizedToken> pathContext)
+{
+    // ids are 3 digits long for grammars with less than 1000 symbols, plus two hashes with separators
+    return 3 * pathContext.size() + 2 * 21;
+}
+} // namespace
 
-    // ts_parser_set_language(parser, languages[lang]());
-    const TSLanguage *lang_parser = tree_sitter_cpp();
-    ts_parser_set_language(parser, lang_parser);
-    tree = ts_parser_parse_string(parser, NULL, src.c_str(), strlen(src.c_str()));
-    root = ts_tree_root_node(tree);
+void
+treesitter::Split::toBranch(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext,
+                            std::string &out)
+{
+    out.reserve(out.size() + splitSize(pathContext));
+    toPath(symbols, pathContext, out);
+    out.push_back('_');
+    appendNumber(out, pathContext.back().name);
 }
 
-std::vector<std::string>
-treesitter::Tree::process()
+void
+treesitter::Split::toPath(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext,
+                          std::string &out)
 {
-    // traverse the tree
-    auto pathVectors = traversal(root);
-    std::vector<std::vector<TokenizedToken>> tokens;
-    for (const auto &path : pathVectors) {
-        // get a tokenized path-context
-        auto temp = tokenizer(path, src, vocab);
-        if (temp.has_value()) {
-            tokens.push_back(temp.value());
+    for (const auto &token : pathContext) {
+        if (token.symbol == turnSymbol) {
+            out.push_back('^');
+        } else {
+            out.append(symbols[token.symbol]);
         }
     }
-    std::vector<std::string> res;
-    for (auto &token : tokens) {
-        // get path-context's final representation
-        res.push_back(split(token));
+}
+
+void
+treesitter::Split::toContext(const SymbolEncoding &symbols, std::span<const TokenizedToken> pathContext,
+                             std::string &out)
+{
+    out.reserve(out.size() + splitSize(pathContext));
+    appendNumber(out, pathContext.front().name);
+    out.push_back('_');
+    toPath(symbols, pathContext, out);
+    out.push_back('_');
+    appendNumber(out, pathContext.back().name);
+}
+
+namespace
+{
+/// A function to load a source file, it's timed as the read stage
+treesitter::SourceBuffer
+readSource(const std::string &fileName)
+{
+    profiler::ScopedTimer timer(profiler::Stage::Read);
+    treesitter::SourceBuffer src(fileName);
+    profiler::count(profiler::Counter::BytesRead, src.view().size());
+    return src;
+}
+} // namespace
+
+treesitter::ParsedTree::ParsedTree(const std::string &fileName, const Language &lang)
+    : ParsedTree(readSource(fileName), lang)
+{
+}
+
+treesitter::ParsedTree::ParsedTree(SourceBuffer &&source, const Language &lang)
+    : src(std::move(source)), grammar(lang.grammar())
+{
+    {
+        // borrowing the parser is timed as well, so the stage compares with creating a parser for every file
+        profiler::ScopedTimer timer(profiler::Stage::Parse);
+        tree = ParserCache::parse(grammar, src.view().data(), src.view().size());
     }
-    return res;
+    root = ts_tree_root_node(tree);
 }
 
-treesitter::Tree::~Tree()
+treesitter::ParsedTree::~ParsedTree()
 {
-    ts_parser_delete(parser);
     ts_tree_delete(tree);
 }
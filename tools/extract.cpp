@@ -22,16 +22,48 @@ this tool will create a new dataset:
   |    |---- sub2_name
   |      ...
 
-  --max_path_length         |-maxlen    |=
-  --max_path_width          |-maxwidth  |=
+  --traversal_policy        |-traversal |= root_terminal (paths from the root to a terminal) or terminal_terminal
+                                           (paths between two terminals through their lowest common ancestor, "^"
+                                           precedes the ancestor, needs -split hash_ids_hash)
+  --split_strategy          |-split     |= ids_hash (<ids>_<last terminal>, for root_terminal) or hash_ids_hash
+                                           (<first terminal>_<ids>_<last terminal>, for terminal_terminal)
+  --max_path_length         |-maxlen    |= terminal_terminal only: maximum number of edges between two terminals
+  --max_path_width          |-maxwidth  |= terminal_terminal only: maximum distance between the children of the
+                                           lowest common ancestor a path goes through
   --num_threads             |-threads   |=
   --batch_size              |-batch     |=
   --export_code_vectors     |-vectors   |=
-  --dataset_language        |-lang      |=
+  --dataset_language        |-lang      |= c, cpp or auto (detect by a file's extension, files of other extensions
+                                           are skipped, every language has its own <lang>|<prefix>_... files)
   --path_contexts_encoding  |-contexts  |=
   --tokens_encoding         |-tokens    |=
-  --dataset_directory       |-dir       |=
+  --dataset_directory       |-dir       |= directory with source files, nested directories (e.g.
+                                           dataset/problem/submission) are walked recursively and in parallel
   --metadata_database       |-tmetadata |=
+  --output_format           |-format    |= text (one line per file) or binary (see extractor/ContextFile.h)
+  --intern_paths            |-intern    |= text output only: write <path id>_<hash> and a separate table of paths
+  --cache_directory         |-cache     |= directory with tokenized files from previous runs, only new or changed files
+                                           are parsed (disabled if empty, hits and misses are in the profile report)
+  --output_shards           |-shards    |= number of output files, a file goes to the shard chosen by the hash of
+                                           its name (<prefix>_tokens.<shard>.txt, <prefix>_contexts.<shard>.bin)
+  --deterministic_output    |-determ    |= sort files by name and paths by their symbols, so every run with the
+                                           same dataset and options writes byte-identical files
+  --compress_output         |-compress  |= text output only: compress the tokens file in independent zlib blocks with
+                                           a block index (<prefix>_tokens.txt.z, see extractor/CompressedFile.h)
+  --profile_report          |-profile   |= path to a JSON report with time per stage (read, parse,
+                                           traversal_tokenization, split, write), counters and files/s (disabled if
+                                           empty)
+  --scratch_arena           |-arena     |= allocate scratch memory of a file from a per-thread arena released at once
+                                           when the file is done (1) or from the heap (0, default)
+  --subtree_memo            |-memo      |= terminal_terminal only: maximum size in MiB of the outputs of subtrees kept
+                                           for the next files of the language, paths of a subtree seen before are
+                                           copied instead of extracted (0 disables it, the hit rate is in the profile
+                                           report)
+  --queue_kind              |-queue     |= queues of the thread pool and the writers: locked (a queue behind a mutex)
+                                           or lock_free (a bounded lock-free ring)
+  --hash_seed               |-seed      |= seed of terminals' hashes (xxh64, the same on every machine)
+  --hash_header             |-hashinfo  |= start the mapping file (and the text tokens file) with a line
+                                           "#hash <algorithm> <seed>"
 
 //#########################################################################################################*/
 
@@ -39,8 +71,8 @@ this tool will create a new dataset:
 #include <support/ArgParser/ArgParser.h>
 
 struct Parameters : public argparser::Arguments {
-    // size_t maxLen;   //
-    // size_t maxWidth; //
+    size_t maxLen;
+    size_t maxWidth;
     size_t numThreads;
     // size_t batch;       //
     // bool exportVectors; //
@@ -53,16 +85,28 @@ struct Parameters : public argparser::Arguments {
     std::string token;
     std::string split;
     std::string outdir;
+    std::string format;
+    bool intern;
+    std::string cache;
+    size_t shards;
+    bool deterministic;
+    bool compress;
+    std::string profile;
+    bool arena;
+    size_t memo;
+    std::string queue;
+    size_t seed;
+    bool hashHeader;
 
     Parameters()
     {
         using namespace argparser;
-        // addParam<"-maxlen", "--max_path_length">(maxLen, NaturalRangeArgument<>(1, {1, 20}));
-        // addParam<"-maxwidth", "--max_path_width">(maxWidth, NaturalRangeArgument<>(1, {1, 20}));
+        addParam<"-maxlen", "--max_path_length">(maxLen, NaturalRangeArgument<>(8, {1, 20}));
+        addParam<"-maxwidth", "--max_path_width">(maxWidth, NaturalRangeArgument<>(2, {1, 20}));
         addParam<"-threads", "--num_threads">(numThreads, NaturalRangeArgument<>(1, {1, 64}));
         // addParam<"-batch", "--batch_size">(batch, NaturalRangeArgument<>(1, {1, 20}));
         // addParam<"-vectors", "--export_code_vectors">(exportVectors, CostrainedArgument());
-        addParam<"-lang", "--dataset_language">(lang, ConstrainedArgument<std::string>("cpp", {"c", "cpp"}));
+        addParam<"-lang", "--dataset_language">(lang, ConstrainedArgument<std::string>("cpp", {"c", "cpp", "auto"}));
         // addParam<"-contexts", "--path_contexts_encoding">(contexts,
         //                        CostrainedArgument<std::string>("tpt", {"tpt", "rt"}));
         // addParam<"-tokens", "--tokens_encoding">(tokens,
@@ -74,8 +118,21 @@ struct Parameters : public argparser::Arguments {
             traversal, ConstrainedArgument<std::string>("root_terminal", {"root_terminal", "terminal_terminal"}));
         addParam<"-token", "--token_rules">(
             token, ConstrainedArgument<std::string>("masked_identifiers", {"masked_identifiers"}));
-        addParam<"-split", "--split_strategy">(split, ConstrainedArgument<std::string>("ids_hash", {"ids_hash"}));
+        addParam<"-split", "--split_strategy">(
+            split, ConstrainedArgument<std::string>("ids_hash", {"ids_hash", "hash_ids_hash"}));
         addParam<"-outdir", "--output_directory">(outdir, DirectoryArgument<std::string>("/home/liudmila"));
+        addParam<"-format", "--output_format">(format, ConstrainedArgument<std::string>("text", {"text", "binary"}));
+        addParam<"-intern", "--intern_paths">(intern, ConstrainedArgument());
+        addParam<"-cache", "--cache_directory">(cache, UnconstrainedArgument<std::string>(""));
+        addParam<"-shards", "--output_shards">(shards, NaturalRangeArgument<>(1, {1, 4096}));
+        addParam<"-determ", "--deterministic_output">(deterministic, ConstrainedArgument());
+        addParam<"-compress", "--compress_output">(compress, ConstrainedArgument());
+        addParam<"-profile", "--profile_report">(profile, UnconstrainedArgument<std::string>(""));
+        addParam<"-arena", "--scratch_arena">(arena, ConstrainedArgument());
+        addParam<"-memo", "--subtree_memo">(memo, NaturalRangeArgument<>(0, {0, 1 << 20}));
+        addParam<"-queue", "--queue_kind">(queue, ConstrainedArgument<std::string>("locked", {"locked", "lock_free"}));
+        addParam<"-seed", "--hash_seed">(seed, NaturalRangeArgument<>(0));
+        addParam<"-hashinfo", "--hash_header">(hashHeader, ConstrainedArgument());
     }
 };
 
@@ -92,6 +149,9 @@ main(int argc, char *argv[])
     } catch (const char *err) {
         std::cerr << err << std::endl;
         return 1;
+    } catch (const std::string &err) {
+        std::cerr << err << std::endl;
+        return 1;
     }
 
     return 0;
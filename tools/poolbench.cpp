@@ -0,0 +1,131 @@
+/*#########################################################################################################//
+Tool for benchmarking threadpool::ThreadPool
+
+Runs a number of no-op tasks through a pool and prints the time per task and the throughput.
+
+  --num_threads             |-threads   |= number of workers
+  --num_tasks               |-tasks     |= number of tasks
+  --submission              |-submit    |= outside (every task is submitted by the main thread), inside (one task
+                                           submits all the others, like a directory walk does), tree (every task
+                                           submits two tasks until there are enough of them) or batch (the main
+                                           thread submits all tasks as one batch)
+  --batch_grain             |-grain     |= batch only: number of tasks in a chunk (0 picks a few chunks per worker)
+  --queue_capacity          |-capacity  |= maximum number of tasks waiting in the pool (0 for unbounded), a task
+                                           submitted by a task is run by it when the pool is full
+  --queue_kind              |-queue     |= queue of tasks submitted from outside: locked or lock_free (needs a capacity)
+  --repetitions             |-reps      |= number of runs, the best one is printed
+
+//#########################################################################################################*/
+
+#include <support/ThreadPool/ThreadPool.h>
+#include <support/ArgParser/ArgParser.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <print>
+
+struct Parameters : public argparser::Arguments {
+    size_t numThreads;
+    size_t numTasks;
+    std::string submit;
+    size_t grain;
+    size_t capacity;
+    std::string queue;
+    size_t reps;
+
+    Parameters()
+    {
+        using namespace argparser;
+        addParam<"-threads", "--num_threads">(numThreads, NaturalRangeArgument<>(4, {1, 256}));
+        addParam<"-tasks", "--num_tasks">(numTasks, NaturalRangeArgument<>(1000000, {1, UINT32_MAX}));
+        addParam<"-submit", "--submission">(
+            submit, ConstrainedArgument<std::string>("outside", {"outside", "inside", "tree", "batch"}));
+        addParam<"-grain", "--batch_grain">(grain, NaturalRangeArgument<>(0, {0, UINT32_MAX}));
+        addParam<"-capacity", "--queue_capacity">(capacity, NaturalRangeArgument<>(0, {0, UINT32_MAX}));
+        addParam<"-queue", "--queue_kind">(queue, ConstrainedArgument<std::string>("locked", {"locked", "lock_free"}));
+        addParam<"-reps", "--repetitions">(reps, NaturalRangeArgument<>(3, {1, 100}));
+    }
+};
+
+namespace
+{
+/// Counter of finished tasks, every task touches it, so the tasks can't be optimized away
+std::atomic_size_t done = 0;
+
+void
+noop()
+{
+    done.fetch_add(1, std::memory_order_relaxed);
+}
+
+/// A task that submits all other tasks
+void
+spawnAll(threadpool::ThreadPool &pool, size_t n)
+{
+    for (size_t i = 1; i < n; ++i) {
+        pool.addTask(noop);
+    }
+    noop();
+}
+
+/// A task that submits the tasks [first, last) as a binary tree
+void
+spawnTree(threadpool::ThreadPool &pool, size_t first, size_t last)
+{
+    noop();
+    size_t mid = first + 1 + (last - first - 1) / 2;
+    if (first + 1 < mid) {
+        pool.addTask(spawnTree, std::ref(pool), first + 1, mid);
+    }
+    if (mid < last) {
+        pool.addTask(spawnTree, std::ref(pool), mid, last);
+    }
+}
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+    try {
+        Parameters params;
+        params.parse(argc, argv);
+
+        double best = 0;
+        for (size_t rep = 0; rep < params.reps; ++rep) {
+            done = 0;
+            auto start = std::chrono::steady_clock::now();
+            {
+                threadpool::ThreadPool pool(params.numThreads, params.capacity,
+                                            params.queue == "lock_free" ? threadpool::QueueKind::LockFree
+                                                                        : threadpool::QueueKind::Locked);
+                if (params.submit == "outside") {
+                    for (size_t i = 0; i < params.numTasks; ++i) {
+                        pool.addTask(noop);
+                    }
+                } else if (params.submit == "batch") {
+                    pool.parallelFor(params.numTasks, [](size_t) { noop(); }, params.grain);
+                } else if (params.submit == "inside") {
+                    pool.addTask(spawnAll, std::ref(pool), params.numTasks);
+                } else {
+                    pool.addTask(spawnTree, std::ref(pool), size_t(0), params.numTasks);
+                }
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (done != params.numTasks) {
+                throw std::format("{} tasks of {} were run", done.load(), params.numTasks);
+            }
+            best = rep == 0 ? seconds : std::min(best, seconds);
+        }
+        std::println("threads {} tasks {} submit {} capacity {} queue {}: {:.3f} s, {:.1f} ns/task, {:.2f} M tasks/s",
+                     params.numThreads, params.numTasks, params.submit, params.capacity, params.queue, best,
+                     best * 1e9 / params.numTasks, params.numTasks / best / 1e6);
+    } catch (const char *err) {
+        std::cerr << err << std::endl;
+        return 1;
+    } catch (const std::string &err) {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*#########################################################################################################//
+Tool for benchmarking the queues of threadpool: ThreadSafeQueue and MPMCRing
+
+Producers push a number of items through a queue, consumers pop them, prints the time per item and the throughput.
+
+  --num_producers           |-producers |= number of producer threads
+  --num_consumers           |-consumers |= number of consumer threads
+  --num_items               |-items     |= number of items pushed by all producers
+  --queue_kind              |-queue     |= locked (ThreadSafeQueue), lock_free (MPMCRing) or both
+  --ring_capacity           |-capacity  |= lock_free only: capacity of the ring, producers wait while it's full
+  --repetitions             |-reps      |= number of runs, the best one is printed
+
+//#########################################################################################################*/
+
+#include <support/ThreadPool/ThreadSafeQueue.h>
+#include <support/ThreadPool/MPMCRing.h>
+#include <support/ArgParser/ArgParser.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <print>
+#include <thread>
+#include <vector>
+
+struct Parameters : public argparser::Arguments {
+    size_t numProducers;
+    size_t numConsumers;
+    size_t numItems;
+    std::string queue;
+    size_t capacity;
+    size_t reps;
+
+    Parameters()
+    {
+        using namespace argparser;
+        addParam<"-producers", "--num_producers">(numProducers, NaturalRangeArgument<>(1, {1, 64}));
+        addParam<"-consumers", "--num_consumers">(numConsumers, NaturalRangeArgument<>(1, {1, 64}));
+        addParam<"-items", "--num_items">(numItems, NaturalRangeArgument<>(1000000, {1, UINT32_MAX}));
+        addParam<"-queue", "--queue_kind">(queue,
+                                           ConstrainedArgument<std::string>("both", {"locked", "lock_free", "both"}));
+        addParam<"-capacity", "--ring_capacity">(capacity, NaturalRangeArgument<>(1024, {2, UINT32_MAX}));
+        addParam<"-reps", "--repetitions">(reps, NaturalRangeArgument<>(3, {1, 100}));
+    }
+};
+
+namespace
+{
+/// Item telling a consumer to stop, it's pushed once all producers are done
+constexpr size_t stop = SIZE_MAX;
+
+/// A function to pass all items through a queue once
+/// @param queue the queue, it's empty
+/// @param params benchmark options
+/// @return time in seconds
+template <typename Queue>
+double
+pass(Queue &queue, const Parameters &params)
+{
+    std::vector<size_t> popped(params.numConsumers);
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<std::jthread> consumers;
+        for (size_t c = 0; c < params.numConsumers; ++c) {
+            consumers.emplace_back([&queue, &popped, c] {
+                // counted locally, so consumers share nothing but the queue
+                size_t n = 0;
+                while (true) {
+                    auto item = queue.pop();
+                    if (!item.has_value()) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    if (*item == stop) {
+                        break;
+                    }
+                    ++n;
+                }
+                popped[c] = n;
+            });
+        }
+        {
+            std::vector<std::jthread> producers;
+            for (size_t p = 0; p < params.numProducers; ++p) {
+                size_t n = params.numItems / params.numProducers + (p < params.numItems % params.numProducers);
+                producers.emplace_back([&queue, n] {
+                    for (size_t i = 0; i < n; ++i) {
+                        queue.push(size_t(i));
+                    }
+                });
+            }
+        }
+        for (size_t c = 0; c < params.numConsumers; ++c) {
+            queue.push(size_t(stop));
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t total = 0;
+    for (auto n : popped) {
+        total += n;
+    }
+    if (total != params.numItems) {
+        throw std::format("{} items of {} were popped", total, params.numItems);
+    }
+    return seconds;
+}
+
+/// A function to benchmark a queue and print the best run
+/// @param name name of the queue
+/// @param make callable creating an empty queue
+/// @param params benchmark options
+template <typename Make>
+void
+bench(std::string_view name, Make make, const Parameters &params)
+{
+    double best = 0;
+    for (size_t rep = 0; rep < params.reps; ++rep) {
+        auto queue = make();
+        double seconds = pass(*queue, params);
+        best = rep == 0 ? seconds : std::min(best, seconds);
+    }
+    std::println("producers {} consumers {} queue {}: {:.3f} s, {:.1f} ns/item, {:.2f} M items/s", params.numProducers,
+                 params.numConsumers, name, best, best * 1e9 / params.numItems, params.numItems / best / 1e6);
+}
+} // namespace
+
+int
+main(int argc, char *argv[])
+{
+    try {
+        Parameters params;
+        params.parse(argc, argv);
+
+        if (params.queue != "lock_free") {
+            bench("locked", [] { return std::make_unique<threadpool::ThreadSafeQueue<size_t>>(); }, params);
+        }
+        if (params.queue != "locked") {
+            bench(
+                "lock_free",
+                [&params] { return std::make_unique<threadpool::MPMCRing<size_t>>(params.capacity); }, params);
+        }
+    } catch (const char *err) {
+        std::cerr << err << std::endl;
+        return 1;
+    } catch (const std::string &err) {
+        std::cerr << err << std::endl;
+        return 1;
+    }
+    return 0;
+}